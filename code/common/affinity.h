@@ -0,0 +1,49 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+/*
+ * Thread pinning shared by the OpenMP exercise code. It needs the GNU
+ * CPU set macros, so define _GNU_SOURCE before including anything.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * Pin each OpenMP thread to its own CPU, taking the CPUs we may run on
+ * in order, so that threads don't migrate away from the memory they
+ * first touched. If OMP_PROC_BIND is set, leave it to the OpenMP
+ * runtime (use OMP_PLACES=cores to avoid sharing hyperthreads).
+ * The runtime reuses the same threads for later parallel regions, so
+ * this only needs doing once.
+ */
+__attribute__((unused))
+static void pin_threads(void)
+{
+#ifdef _OPENMP
+  cpu_set_t allowed;
+
+  if (getenv("OMP_PROC_BIND") || sched_getaffinity(0, sizeof(allowed), &allowed))
+    return;
+#pragma omp parallel
+  {
+    const int ncpu = CPU_COUNT(&allowed);
+    int which = omp_get_thread_num() % ncpu;
+    cpu_set_t mine;
+    int cpu;
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      if (CPU_ISSET(cpu, &allowed) && which-- == 0)
+        break;
+    CPU_ZERO(&mine);
+    CPU_SET(cpu, &mine);
+    if (sched_setaffinity(0, sizeof(mine), &mine))
+      perror("sched_setaffinity");
+  }
+#endif
+}
+
+#endif  /* AFFINITY_H */
@@ -0,0 +1,318 @@
+#ifndef BENCH_H
+#define BENCH_H
+/*
+ * The benchmark harness shared by the exercise code, so that every
+ * program times its kernels the same way and the results can be
+ * compared.
+ *
+ * A kernel to time is a function that runs reps repetitions of it and
+ * returns how long they took in seconds:
+ *
+ *   double fn(void *ctx, size_t reps);
+ *
+ * bench_run first calibrates reps: it grows reps until one call takes
+ * at least BENCH_MIN_TIME seconds, so that the timer resolution and
+ * the overhead of a call don't matter. These calls also warm up the
+ * caches, the page tables, and the clock frequency. It then makes
+ * BENCH_WARMUP calls that it throws away, and BENCH_SAMPLES calls
+ * that are the samples. The result is the minimum, median, mean, and
+ * standard deviation of the time per repetition over the samples.
+ * Quote the median, the minimum says what the hardware can do, and
+ * the standard deviation how far to trust either.
+ *
+ * Only the times fn returns decide reps, so processes that agree on
+ * them (say, fn returns the maximum over all of them) agree on reps.
+ * The samples are always the last BENCH_SAMPLES calls of fn, so a
+ * kernel that measures something else as well (cycles, say) can keep
+ * its own samples and summarise them with bench_stats.
+ *
+ * bench_report writes one record per result: the name and parameters
+ * of the benchmark, the statistics, and the rate of work (FLOP, LUP,
+ * bytes, ...) at the median and the minimum time, with the host, CPU
+ * model, number of CPUs, compiler, OpenMP threads, and date, so that
+ * results from different machines and builds can be told apart.
+ *
+ * Everything is set with environment variables:
+ *
+ *   BENCH_MIN_TIME  seconds per sample (default 0.2)
+ *   BENCH_SAMPLES   number of samples (default 5)
+ *   BENCH_WARMUP    calls thrown away after calibration (default 1)
+ *   BENCH_FORMAT    text, csv, or json (one object per line) for the
+ *                   records (default text)
+ *   BENCH_FILE      file to append the records to, with a csv header
+ *                   if the file is empty (default: standard error)
+ *
+ * The usual output of each program on standard output is unchanged,
+ * but computed from the median. For example, to collect a sweep into
+ * one table
+ *
+ *   export BENCH_FORMAT=csv BENCH_FILE=dmvm.csv
+ *   for n in 1000 2000 4000; do ./dmvm $n 10000; done
+ *
+ * Everything here is static, include it in the file with main. Not
+ * every program uses every function, hence the unused attributes.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/* Most samples we keep */
+#define BENCH_MAX_SAMPLES 1000
+
+/* GCC's version string doesn't say it is GCC, clang's and icc's do */
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__INTEL_COMPILER)
+#define BENCH_COMPILER "GCC " __VERSION__
+#else
+#define BENCH_COMPILER __VERSION__
+#endif
+
+typedef double (*bench_fn_t)(void *, size_t);
+
+typedef struct BenchResult {
+  size_t reps;              /* repetitions per sample */
+  int samples;
+  const char *time_unit;    /* of the statistics, "s" from bench_run */
+  double min, median, mean, stddev;   /* per repetition */
+} BenchResult;
+
+__attribute__((unused))
+static double bench_timestamp(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1.e-9;
+}
+
+static double bench_env(const char *name, double def)
+{
+  const char *value = getenv(name);
+  return value && *value ? atof(value) : def;
+}
+
+/* Newton's method, so that programs that don't otherwise use libm
+ * needn't link it */
+static double bench_sqrt(double x)
+{
+  double r, next;
+
+  if (x <= 0)
+    return 0;
+  /* Start above the root, then the iterates go down until rounding */
+  r = x > 1 ? x : 1;
+  for (;;) {
+    next = 0.5*(r + x/r);
+    if (next >= r)
+      return r;
+    r = next;
+  }
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+  const double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/*
+ * Statistics of n samples t of the cost of reps repetitions, in
+ * time_unit. Sorts t.
+ */
+__attribute__((unused))
+static void bench_stats(double *t, int n, size_t reps, const char *time_unit, BenchResult *r)
+{
+  double sum = 0, sum2 = 0;
+  int s;
+
+  qsort(t, n, sizeof(*t), bench_compare);
+  for (s = 0; s < n; s++)
+    sum += t[s];
+  r->reps = reps;
+  r->samples = n;
+  r->time_unit = time_unit;
+  r->mean = sum / n;
+  for (s = 0; s < n; s++)
+    sum2 += (t[s] - r->mean)*(t[s] - r->mean);
+  r->min = t[0] / reps;
+  r->median = (n%2 ? t[n/2] : 0.5*(t[n/2 - 1] + t[n/2])) / reps;
+  r->stddev = n > 1 ? bench_sqrt(sum2 / (n - 1)) / reps : 0;
+  r->mean /= reps;
+}
+
+/* Calibrate, warm up, and sample fn(ctx, reps), see above */
+__attribute__((unused))
+static void bench_run(bench_fn_t fn, void *ctx, BenchResult *r)
+{
+  const double min_time = bench_env("BENCH_MIN_TIME", 0.2);
+  const int warmup = (int)bench_env("BENCH_WARMUP", 1);
+  int samples = (int)bench_env("BENCH_SAMPLES", 5);
+  double t[BENCH_MAX_SAMPLES];
+  double time;
+  size_t reps = 1;
+  int s;
+
+  if (samples < 1)
+    samples = 1;
+  if (samples > BENCH_MAX_SAMPLES)
+    samples = BENCH_MAX_SAMPLES;
+  /* Aim 20% past the target. Times far below it are mostly noise, so
+   * grow by at most a factor 100 at a time. */
+  while ((time = fn(ctx, reps)) < min_time) {
+    const double scale = time > 0 && 1.2*min_time/time < 100 ? 1.2*min_time/time : 100;
+    const size_t next = (size_t)(reps*scale);
+    reps = next > reps ? next : reps + 1;
+  }
+  for (s = 0; s < warmup; s++)
+    fn(ctx, reps);
+  for (s = 0; s < samples; s++)
+    t[s] = fn(ctx, reps);
+  bench_stats(t, samples, reps, "s", r);
+}
+
+/* The model name from /proc/cpuinfo, or "unknown" */
+static void bench_cpu_model(char *model, size_t len)
+{
+  FILE *f = fopen("/proc/cpuinfo", "r");
+  char line[512];
+
+  snprintf(model, len, "unknown");
+  if (!f)
+    return;
+  while (fgets(line, sizeof(line), f)) {
+    char *value = strchr(line, ':');
+    if (value && !strncmp(line, "model name", 10)) {
+      value += strspn(value, ": \t");
+      value[strcspn(value, "\n")] = '\0';
+      snprintf(model, len, "%s", value);
+      break;
+    }
+  }
+  fclose(f);
+}
+
+/* A quoted string, with quotes escaped for csv or json */
+static void bench_print_string(FILE *f, const char *s, int json)
+{
+  fputc('"', f);
+  for (; *s; s++) {
+    if (*s == '"')
+      fputs(json ? "\\\"" : "\"\"", f);
+    else if (*s == '\\' && json)
+      fputs("\\\\", f);
+    else
+      fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+/* Fields of a record, and which of them are strings */
+#define BENCH_NFIELDS 19
+static const char *bench_fields[BENCH_NFIELDS] = {
+  "name", "params", "reps", "samples", "time_unit", "min", "median", "mean", "stddev",
+  "work", "unit", "rate", "best_rate", "host", "cpu", "ncpu", "compiler", "threads", "date"};
+static const int bench_quoted[BENCH_NFIELDS] = {
+  1, 1, 0, 0, 1, 0, 0, 0, 0,
+  0, 1, 0, 0, 1, 1, 0, 1, 0, 1};
+
+/*
+ * Write the record for result r of benchmark name, with parameters
+ * params (say "rows=1000 cols=2000"), which does work units of unit
+ * (say "FLOP") per repetition.
+ */
+__attribute__((unused))
+static void bench_report(const char *name, const char *params, const BenchResult *r,
+                         double work, const char *unit)
+{
+  static int header_done = 0;
+  const char *format = getenv("BENCH_FORMAT") ? getenv("BENCH_FORMAT") : "text";
+  const char *path = getenv("BENCH_FILE");
+  const time_t now = time(NULL);
+  char values[BENCH_NFIELDS][256];
+  char host[256], cpu[256];
+  int json, threads, header, f;
+  FILE *out = stderr;
+
+  if (strcmp(format, "text") && strcmp(format, "csv") && strcmp(format, "json")) {
+    fprintf(stderr, "Unknown BENCH_FORMAT '%s', expecting text, csv, or json\n", format);
+    return;
+  }
+  if (path && !(out = fopen(path, "a"))) {
+    perror(path);
+    return;
+  }
+  if (!strcmp(format, "text")) {
+    fprintf(out, "# %s %s: median %g %s (min %g, stddev %.1f%%) per rep, %d samples of %zu reps, "
+            "%g %s/%s (best %g)\n",
+            name, params, r->median, r->time_unit, r->min,
+            r->median > 0 ? 100*r->stddev/r->median : 0, r->samples, r->reps,
+            work/r->median, unit, r->time_unit, work/r->min);
+    if (out != stderr)
+      fclose(out);
+    return;
+  }
+
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#else
+  threads = 1;
+#endif
+  if (gethostname(host, sizeof(host)))
+    snprintf(host, sizeof(host), "unknown");
+  host[sizeof(host) - 1] = '\0';
+  bench_cpu_model(cpu, sizeof(cpu));
+  snprintf(values[0], sizeof(values[0]), "%s", name);
+  snprintf(values[1], sizeof(values[1]), "%s", params);
+  snprintf(values[2], sizeof(values[2]), "%zu", r->reps);
+  snprintf(values[3], sizeof(values[3]), "%d", r->samples);
+  snprintf(values[4], sizeof(values[4]), "%s", r->time_unit);
+  snprintf(values[5], sizeof(values[5]), "%.6e", r->min);
+  snprintf(values[6], sizeof(values[6]), "%.6e", r->median);
+  snprintf(values[7], sizeof(values[7]), "%.6e", r->mean);
+  snprintf(values[8], sizeof(values[8]), "%.6e", r->stddev);
+  snprintf(values[9], sizeof(values[9]), "%.6e", work);
+  snprintf(values[10], sizeof(values[10]), "%s", unit);
+  snprintf(values[11], sizeof(values[11]), "%.6e", work/r->median);
+  snprintf(values[12], sizeof(values[12]), "%.6e", work/r->min);
+  snprintf(values[13], sizeof(values[13]), "%s", host);
+  snprintf(values[14], sizeof(values[14]), "%s", cpu);
+  snprintf(values[15], sizeof(values[15]), "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+  snprintf(values[16], sizeof(values[16]), "%s", BENCH_COMPILER);
+  snprintf(values[17], sizeof(values[17]), "%d", threads);
+  strftime(values[18], sizeof(values[18]), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+  json = !strcmp(format, "json");
+  if (path) {
+    fseek(out, 0, SEEK_END);
+    header = ftell(out) == 0;
+  } else {
+    header = !header_done;
+  }
+  header_done = 1;
+  if (header && !json) {
+    for (f = 0; f < BENCH_NFIELDS; f++)
+      fprintf(out, "%s%s", f ? "," : "", bench_fields[f]);
+    fputc('\n', out);
+  }
+  if (json)
+    fputc('{', out);
+  for (f = 0; f < BENCH_NFIELDS; f++) {
+    if (f)
+      fputc(',', out);
+    if (json)
+      fprintf(out, "\"%s\":", bench_fields[f]);
+    if (bench_quoted[f])
+      bench_print_string(out, values[f], json);
+    else
+      fputs(values[f], out);
+  }
+  fputs(json ? "}\n" : "\n", out);
+  if (out != stderr)
+    fclose(out);
+}
+
+#endif  /* BENCH_H */
@@ -32,6 +32,8 @@
 #include <limits.h>
 #include <float.h>
 
+#include "../common/bench.h"
+
 #ifdef LIKWID_PERFMON
 #include <likwid.h>
 #else
@@ -50,11 +52,25 @@
 #define MIN(x,y) ((x)<(y)?(x):(y))
 #endif
 
-double getTimeStamp()
+static inline void single_dmvm(
+                               double * restrict y,
+                               const double * restrict a,
+                               const double * restrict x,
+                               int N_rows,
+                               int N_cols
+                               )
 {
-  struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  return (double)ts.tv_sec + (double)ts.tv_nsec * 1.e-9;
+  for (int rb=0; rb<N_rows; rb+=RB) {
+    int rbS = rb;
+    int rbE = MIN((rb+RB),N_rows);
+
+    for (int c=0; c<N_cols; c++) {
+      for (int r=rbS; r<rbE; r++) {
+        y[r] = y[r] + a[c*N_rows+r] * x[c];
+      }
+    }
+  }
+  if (a[N_rows-1] > 2000) printf("Ai = %f\n",a[N_rows-1]);
 }
 
 double dmvm(
@@ -68,65 +84,49 @@ double dmvm(
 {
   double S, E;
 
-  S = getTimeStamp();
+  S = bench_timestamp();
   LIKWID_MARKER_START("bench");
 
   for(int j = 0; j < iter; j++) {
-    for (int rb=0; rb<N_rows; rb+=RB) {
-      int rbS = rb;
-      int rbE = MIN((rb+RB),N_rows);
-
-      for (int c=0; c<N_cols; c++) {
-        for (int r=rbS; r<rbE; r++) {
-          y[r] = y[r] + a[c*N_rows+r] * x[c];
-        }
-      }
-    }
-    if (a[N_rows-1] > 2000) printf("Ai = %f\n",a[N_rows-1]);
+    single_dmvm(y, a, x, N_rows, N_cols);
   }
-
   LIKWID_MARKER_STOP("bench");
-  E = getTimeStamp();
+  E = bench_timestamp();
 
   return E-S;
 }
 
-double dmvm_test(
-                 double * restrict y,
-                 const double * restrict a,
-                 const double * restrict x,
-                 int N_rows,
-                 int N_cols,
-                 int iter
-                 )
+typedef struct DmvmArgs {
+  double *y;
+  const double *a, *x;
+  int N_rows, N_cols;
+} DmvmArgs;
+
+/* As dmvm, but outside the marker region, so that calibration and the
+ * samples don't count */
+static double dmvm_bench(void *ctx, size_t reps)
 {
+  DmvmArgs *d = ctx;
   double S, E;
 
-  S = getTimeStamp();
-  for(int j = 0; j < iter; j++) {
-    for (int c=0; c<N_cols; c++) {
-      for (int r=0; r<N_rows; r++) {
-        y[r] = y[r] + a[c*N_rows+r] * x[c];
-      }
-    }
-    if (a[N_rows-1] > 2000) printf("Ai = %f\n",a[N_rows-1]);
+  S = bench_timestamp();
+  for(size_t j = 0; j < reps; j++) {
+    single_dmvm(d->y, d->a, d->x, d->N_rows, d->N_cols);
   }
-  E = getTimeStamp();
+  E = bench_timestamp();
 
   return E-S;
 }
 
-
 int main (int argc, char** argv)
 {
   size_t bytesPerWord = sizeof(double);
   size_t N_rows = 0;
   size_t N_cols = 0;
-  size_t iter = 1;
   double *a, *x, *y;
-  double E, S;
-  double times[2];
-  double walltime;
+  DmvmArgs args;
+  BenchResult result;
+  char params[64];
 
   if ( argc > 2 ) {
     N_rows = atoi(argv[1]);
@@ -152,21 +152,22 @@ int main (int argc, char** argv)
     }
   }
 
-  times[0] = 0.0;
-  times[1] = 0.0;
-
-  while ( times[0] < 0.6 ){
-    times[0] = dmvm_test(y, a, x, N_rows, N_cols, iter);
-    if ( times[0] > 0.2 ) break;
-    double factor = 0.6 / (times[0] - times[1]);
-    iter *= (int) factor;
-    times[1] = times[0];
-  }
-
-  walltime = dmvm(y, a, x, N_rows, N_cols, iter);
+  args.y = y;
+  args.a = a;
+  args.x = x;
+  args.N_rows = N_rows;
+  args.N_cols = N_cols;
+  bench_run(dmvm_bench, &args, &result);
+#ifdef LIKWID_PERFMON
+  /* The marker region counts one pass of as many iterations as a
+   * sample */
+  dmvm(y, a, x, N_rows, N_cols, result.reps);
+#endif
 
-  double flops = (double) 2.0 * N_cols * N_rows * iter;
-  printf("%zu %zu %zu %.2f\n", iter, N_rows, N_cols, 1.0E-06 * flops/walltime);
+  double flops = (double) 2.0 * N_cols * N_rows;
+  printf("%zu %zu %zu %.2f\n", result.reps, N_rows, N_cols, 1.0E-06 * flops/result.median);
+  snprintf(params, sizeof(params), "rows=%zu cols=%zu", N_rows, N_cols);
+  bench_report("dmvm-blocked", params, &result, flops, "FLOP");
 
   LIKWID_MARKER_CLOSE;
   return EXIT_SUCCESS;
@@ -6,6 +6,8 @@
 #include <immintrin.h>
 #include <time.h>
 
+#include "../common/bench.h"
+
 #ifdef LIKWID_PERFMON
 #include <likwid.h>
 #else
@@ -125,7 +127,25 @@ static void aligned(int n,
   }
   LIKWID_MARKER_STOP("ALIGNED");
 }
-                    
+
+typedef void (*loop_fn_t)(int, const double *, const double *, double *);
+
+typedef struct LoopArgs {
+  loop_fn_t loop;
+  int n;
+  const double *a, *b;
+  double *c;
+} LoopArgs;
+
+static double loop_bench(void *ctx, size_t reps)
+{
+  LoopArgs *l = ctx;
+  double start = bench_timestamp();
+  size_t r;
+  for (r = 0; r < reps; r++)
+    l->loop(l->n, l->a, l->b, l->c);
+  return bench_timestamp() - start;
+}
 
 int main(int argc, char **argv)
 {
@@ -133,7 +153,8 @@ int main(int argc, char **argv)
   double *b = NULL;
   double *c = NULL;
   double sum = 0;
-  int n;
+  int n, offset = 0;
+  loop_fn_t loop;
   LIKWID_MARKER_INIT;
   LIKWID_MARKER_THREADINIT;
   LIKWID_MARKER_REGISTER("Scalar");
@@ -170,17 +191,18 @@ int main(int argc, char **argv)
     c[i] = 0;
   }
   if (!strcmp(argv[2], "sca")) {
-    scalar_loop(n, a, b, c);
+    loop = scalar_loop;
   } else if (!strcmp(argv[2], "sse")) {
-    sse_loop(n, a, b, c);
+    loop = sse_loop;
   } else if (!strcmp(argv[2], "avx")) {
-    avx_loop(n, a, b, c);
+    loop = avx_loop;
   } else if (!strcmp(argv[2], "fma")) {
-    fma_loop(n, a, b, c);
+    loop = fma_loop;
   } else if (!strcmp(argv[2], "align")) {
-    aligned(n, a, b, c);
+    loop = aligned;
   } else if (!strcmp(argv[2], "unalign")) {
-    unaligned(n, a+1, b+1, c+1);
+    loop = unaligned;
+    offset = 1;
   } else {
     fprintf(stderr, "Unrecognised LOOP_TYPE: %s\n", argv[2]);
     free(a);
@@ -189,9 +211,27 @@ int main(int argc, char **argv)
     LIKWID_MARKER_CLOSE;
     return 1;
   }
+  loop(n, a + offset, b + offset, c + offset);
   for (int i = 0; i < n; i++) {
     sum += c[i];
   }
+  /* The marker regions count a single sweep, so only time the loops
+   * when we aren't counting */
+#ifndef LIKWID_PERFMON
+  {
+    LoopArgs args;
+    BenchResult result;
+    char params[64];
+    args.loop = loop;
+    args.n = n;
+    args.a = a + offset;
+    args.b = b + offset;
+    args.c = c + offset;
+    bench_run(loop_bench, &args, &result);
+    snprintf(params, sizeof(params), "loop=%s n=%d", argv[2], n);
+    bench_report("stream", params, &result, 2.0*n, "FLOP");
+  }
+#endif
   LIKWID_MARKER_CLOSE;  
   printf("%s loop, sum %g\n", argv[2], sum);
   free(a);
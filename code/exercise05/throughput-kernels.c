@@ -0,0 +1,125 @@
+/*
+ * The peak and reduction kernels for one instruction set. throughput.c
+ * includes this file once per instruction set, after defining
+ *
+ *   VEC            the register type, double or a GCC vector of doubles
+ *   WIDTH          doubles in a VEC
+ *   ISA_FN(f)      the name of function f for this instruction set
+ *   ISA_ATTRS      function attributes: the target, and for scalar
+ *                  code, no vectorisation
+ *
+ * The accumulators are an array indexed by compile time constants
+ * once the kernel is inlined into the switch over the number of
+ * chains, so the compiler keeps them in registers.
+ */
+
+/* Sum of all the entries of acc[0:n] */
+static inline __attribute__((always_inline)) ISA_ATTRS
+double ISA_FN(sum_)(const VEC *acc, const int n)
+{
+  VEC total = {0};
+  double lanes[WIDTH];
+  double sum = 0;
+  int c, w;
+
+  for (c = 0; c < n; c++)
+    total += acc[c];
+  memcpy(lanes, &total, sizeof(total));
+  for (w = 0; w < WIDTH; w++)
+    sum += lanes[w];
+  return sum;
+}
+
+/*
+ * iters times, update chains independent accumulators with
+ * acc = acc*x + y. Each update is a dependent FMA on its own chain, so
+ * one chain runs at the FMA latency and enough of them at the FMA
+ * throughput. Returns the sum of the accumulators, so the work can't
+ * be thrown away.
+ */
+static inline __attribute__((always_inline)) ISA_ATTRS
+double ISA_FN(fma_chains_)(long iters, const int chains)
+{
+  const VEC zero = {0};
+  const VEC x = zero + 0.9999999;
+  const VEC y = zero + 1e-7;
+  VEC acc[MAX_CHAINS];
+  long it;
+  int c;
+
+#pragma GCC unroll 16
+  for (c = 0; c < chains; c++)
+    acc[c] = zero + (double)c;
+  for (it = 0; it < iters; it++) {
+#pragma GCC unroll 16
+    for (c = 0; c < chains; c++)
+      acc[c] = acc[c]*x + y;
+  }
+  return ISA_FN(sum_)(acc, chains);
+}
+
+/*
+ * Sum the n doubles in a (64 byte aligned, n a multiple of 8) with
+ * accumulators partial sums, repeats times. Each add depends on the
+ * previous one into the same accumulator.
+ */
+static inline __attribute__((always_inline)) ISA_ATTRS
+double ISA_FN(reduction_)(long n, const double *a, long repeats,
+                          const int accumulators)
+{
+  const VEC zero = {0};
+  VEC acc[MAX_CHAINS];
+  double sum = 0;
+  long i, r;
+  int c;
+
+  for (r = 0; r < repeats; r++) {
+#pragma GCC unroll 16
+    for (c = 0; c < accumulators; c++)
+      acc[c] = zero;
+    for (i = 0; i + accumulators*WIDTH <= n; i += accumulators*WIDTH) {
+#pragma GCC unroll 16
+      for (c = 0; c < accumulators; c++)
+        acc[c] += *(const VEC *)&a[i + c*WIDTH];
+    }
+    for (; i < n; i += WIDTH)
+      acc[0] += *(const VEC *)&a[i];
+    sum += ISA_FN(sum_)(acc, accumulators);
+  }
+  return sum;
+}
+
+#define CHAIN_CASES(call)                                       \
+  case 1: return call(1); case 2: return call(2);               \
+  case 3: return call(3); case 4: return call(4);               \
+  case 5: return call(5); case 6: return call(6);               \
+  case 7: return call(7); case 8: return call(8);               \
+  case 9: return call(9); case 10: return call(10);             \
+  case 11: return call(11); case 12: return call(12);           \
+  case 13: return call(13); case 14: return call(14);           \
+  case 15: return call(15); case 16: return call(16);
+
+static __attribute__((noinline)) ISA_ATTRS
+double ISA_FN(fma_chains)(long iters, int chains)
+{
+#define CALL(c) ISA_FN(fma_chains_)(iters, c)
+  switch (chains) {
+    CHAIN_CASES(CALL)
+  }
+#undef CALL
+  return 0;
+}
+
+static __attribute__((noinline)) ISA_ATTRS
+double ISA_FN(reduction)(long n, const double *a, long repeats,
+                         int accumulators)
+{
+#define CALL(c) ISA_FN(reduction_)(n, a, repeats, c)
+  switch (accumulators) {
+    CHAIN_CASES(CALL)
+  }
+#undef CALL
+  return 0;
+}
+
+#undef CHAIN_CASES
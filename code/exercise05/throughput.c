@@ -0,0 +1,307 @@
+/* Peak floating point and sum reduction throughput with different instruction sets */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+
+#include "../common/bench.h"
+
+/*
+ * Two benchmarks, for scalar, 128 bit, AVX (256 bit), and AVX-512
+ * code:
+ *
+ * peak: independent chains of FMAs, acc = acc*x + y, with 1 to 16
+ *   chains. With one chain we see the FMA latency, with enough chains
+ *   to cover latency times throughput, the peak. Each chain is one
+ *   register, so the number of chains is also the unroll factor of
+ *   the loop.
+ *
+ * reduction: sum of an array with 1 to 16 accumulators, for arrays
+ *   from 1KB to 128MB, so we walk down the memory hierarchy.
+ *
+ * Each runs on one core, or on THREADS cores ("all" for all OpenMP
+ * threads), each thread doing the same work on its own data. Pin the
+ * threads (OMP_PROC_BIND=true) for sensible all-core numbers.
+ *
+ * The scalar and 128 bit variants are compiled for FMA too, so that
+ * they all count the same instructions: the 128 bit column is VEX
+ * encoded FMAs and adds on xmm registers (FMA128), not SSE, and needs
+ * an FMA capable CPU like the scalar one.
+ *
+ * The output is a table with one column per instruction set (nan if
+ * this CPU doesn't support it), headed by the column names, which the
+ * figure scripts read with numpy.genfromtxt:
+ *
+ *   ./throughput peak 1 > peak.dat
+ *   python figures/roofline-example.py --peak peak.dat roofline.pdf
+ *   ./throughput reduction 1 > reduction.dat
+ *   python figures/sum-reduction-throughput.py --data reduction.dat \
+ *     --peak peak.dat reduction.pdf
+ *
+ * The instruction sets are selected per function with target
+ * attributes, so compile without -march, with GCC or clang:
+ *
+ *   gcc -O2 -fopenmp -o throughput throughput.c
+ *
+ * Don't use -ffast-math: it would let the compiler reassociate the
+ * scalar reduction into a vectorised one.
+ *
+ * Each entry is the median of BENCH_SAMPLES timed runs, see
+ * ../common/bench.h. There are hundreds of entries, so unless they are
+ * set in the environment this program takes 3 samples of at least
+ * 0.1 seconds.
+ */
+
+#define MAX_CHAINS 16
+
+typedef double v2d __attribute__((vector_size(16)));
+typedef double v4d __attribute__((vector_size(32)));
+typedef double v8d __attribute__((vector_size(64)));
+
+#define VEC double
+#define WIDTH 1
+#define ISA_FN(f) scalar_##f
+#define ISA_ATTRS __attribute__((target("fma"), optimize("no-tree-vectorize")))
+#include "throughput-kernels.c"
+#undef VEC
+#undef WIDTH
+#undef ISA_FN
+#undef ISA_ATTRS
+
+#define VEC v2d
+#define WIDTH 2
+#define ISA_FN(f) fma128_##f
+#define ISA_ATTRS __attribute__((target("fma")))
+#include "throughput-kernels.c"
+#undef VEC
+#undef WIDTH
+#undef ISA_FN
+#undef ISA_ATTRS
+
+#define VEC v4d
+#define WIDTH 4
+#define ISA_FN(f) avx_##f
+#define ISA_ATTRS __attribute__((target("avx2,fma")))
+#include "throughput-kernels.c"
+#undef VEC
+#undef WIDTH
+#undef ISA_FN
+#undef ISA_ATTRS
+
+#define VEC v8d
+#define WIDTH 8
+#define ISA_FN(f) avx512_##f
+#define ISA_ATTRS __attribute__((target("avx512f")))
+#include "throughput-kernels.c"
+#undef VEC
+#undef WIDTH
+#undef ISA_FN
+#undef ISA_ATTRS
+
+#define NISA 4
+
+static const struct {
+  const char *name;
+  const char *feature;
+  int width;
+  double (*fma_chains)(long, int);
+  double (*reduction)(long, const double *, long, int);
+} isas[NISA] = {
+  {"SCALAR", "fma", 1, scalar_fma_chains, scalar_reduction},
+  {"FMA128", "fma", 2, fma128_fma_chains, fma128_reduction},
+  {"AVX", "avx2", 4, avx_fma_chains, avx_reduction},
+  {"AVX512", "avx512f", 8, avx512_fma_chains, avx512_reduction},
+};
+
+/* Array sizes for the reduction */
+#define MIN_BYTES 1024L
+#define MAX_BYTES (128L*1024*1024)
+
+static int supported(int isa)
+{
+  __builtin_cpu_init();
+  /* __builtin_cpu_supports needs a string literal */
+  if (!strcmp(isas[isa].feature, "fma"))
+    return __builtin_cpu_supports("fma");
+  if (!strcmp(isas[isa].feature, "avx2"))
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  if (!strcmp(isas[isa].feature, "avx512f"))
+    return __builtin_cpu_supports("avx512f");
+  return 0;
+}
+
+typedef struct ThroughputArgs {
+  int isa, chains, threads;
+  long n;
+  double sink;
+} ThroughputArgs;
+
+/* reps iterations of the FMA chains on each thread */
+static double peak_bench(void *ctx, size_t reps)
+{
+  ThroughputArgs *t = ctx;
+  double start = 0, end = 0, sink = 0;
+
+#pragma omp parallel num_threads(t->threads) reduction(+:sink)
+  {
+#pragma omp barrier
+#pragma omp master
+    start = omp_get_wtime();
+    sink += isas[t->isa].fma_chains(reps, t->chains);
+#pragma omp barrier
+#pragma omp master
+    end = omp_get_wtime();
+  }
+  t->sink += sink;
+  return end - start;
+}
+
+/* reps sums of its own array of n doubles on each thread */
+static double reduction_bench(void *ctx, size_t reps)
+{
+  ThroughputArgs *t = ctx;
+  double start = 0, end = 0, sink = 0;
+
+#pragma omp parallel num_threads(t->threads) reduction(+:sink)
+  {
+    double *a = NULL;
+    long i;
+    if (posix_memalign((void **)&a, 64, t->n*sizeof(*a)))
+      abort();
+    /* First touch, so the array is local to the thread */
+    for (i = 0; i < t->n; i++)
+      a[i] = 1.0 / (i + 1);
+    /* Warm up */
+    sink += isas[t->isa].reduction(t->n, a, 1, t->chains);
+#pragma omp barrier
+#pragma omp master
+    start = omp_get_wtime();
+    sink += isas[t->isa].reduction(t->n, a, reps, t->chains);
+#pragma omp barrier
+#pragma omp master
+    end = omp_get_wtime();
+    free(a);
+  }
+  t->sink += sink;
+  return end - start;
+}
+
+/*
+ * GFLOP/s of chains FMA chains with instruction set isa on threads
+ * threads.
+ */
+static double peak(int isa, int chains, int threads)
+{
+  ThroughputArgs args = {isa, chains, threads, 0, 0};
+  BenchResult result;
+  char params[64];
+  const double flop = 2.0*isas[isa].width*chains*threads;
+
+  bench_run(peak_bench, &args, &result);
+  if (args.sink != args.sink)
+    fprintf(stderr, "NaN in FMA chains\n");
+  snprintf(params, sizeof(params), "isa=%s chains=%d threads=%d", isas[isa].name, chains, threads);
+  bench_report("throughput/peak", params, &result, flop, "FLOP");
+  return flop / result.median * 1e-9;
+}
+
+/*
+ * MFLOP/s of a sum reduction of n doubles with accumulators
+ * accumulators and instruction set isa on threads threads, each
+ * thread summing its own array.
+ */
+static double reduction(int isa, long n, int accumulators, int threads)
+{
+  ThroughputArgs args = {isa, accumulators, threads, n, 0};
+  BenchResult result;
+  char params[96];
+  const double flop = (double)n*threads;
+
+  bench_run(reduction_bench, &args, &result);
+  if (args.sink != args.sink)
+    fprintf(stderr, "NaN in reduction\n");
+  snprintf(params, sizeof(params), "isa=%s bytes=%ld accumulators=%d threads=%d",
+           isas[isa].name, n*(long)sizeof(double), accumulators, threads);
+  bench_report("throughput/reduction", params, &result, flop, "FLOP");
+  return flop / result.median * 1e-6;
+}
+
+int main(int argc, char **argv)
+{
+  int threads = 1;
+  int isa, c;
+
+  if (argc < 2 || argc > 4) {
+    fprintf(stderr, "Usage: %s MODE [THREADS [ACCUMULATORS]]\n", argv[0]);
+    fprintf(stderr, "Where MODE is one of:\n");
+    fprintf(stderr, "  peak - GFLOP/s of 1 to 16 independent FMA chains\n");
+    fprintf(stderr, "  reduction - MFLOP/s of a sum reduction against array size\n");
+    fprintf(stderr, "THREADS is a number, or all (default 1)\n");
+    fprintf(stderr, "ACCUMULATORS (reduction only) is 1 to 16 (default 1), or all\n");
+    return 1;
+  }
+  setenv("BENCH_MIN_TIME", "0.1", 0);
+  setenv("BENCH_SAMPLES", "3", 0);
+  if (argc > 2)
+    threads = strcmp(argv[2], "all") ? atoi(argv[2]) : omp_get_max_threads();
+  if (threads < 1) {
+    fprintf(stderr, "Invalid THREADS: %s\n", argv[2]);
+    return 1;
+  }
+  for (isa = 0; isa < NISA; isa++)
+    if (!supported(isa))
+      fprintf(stderr, "%s not supported on this CPU\n", isas[isa].name);
+
+  if (!strcmp(argv[1], "peak")) {
+    printf("# CHAINS");
+    for (isa = 0; isa < NISA; isa++)
+      printf(" %s", isas[isa].name);
+    printf("\n# GFLOP/s with %d threads\n", threads);
+    for (c = 1; c <= MAX_CHAINS; c++) {
+      printf("%d", c);
+      for (isa = 0; isa < NISA; isa++)
+        printf(" %g", supported(isa) ? peak(isa, c, threads) : NAN);
+      printf("\n");
+      fflush(stdout);
+    }
+  } else if (!strcmp(argv[1], "reduction")) {
+    const char *acc = argc > 3 ? argv[3] : "1";
+    const int all = !strcmp(acc, "all");
+    const int accumulators = all ? 0 : atoi(acc);
+    long bytes;
+    if (!all && (accumulators < 1 || accumulators > MAX_CHAINS)) {
+      fprintf(stderr, "Invalid ACCUMULATORS: %s\n", acc);
+      return 1;
+    }
+    printf("# BYTES");
+    for (isa = 0; isa < NISA; isa++)
+      printf(" %s", isas[isa].name);
+    printf("\n# MFLOP/s with %d threads, %s accumulators, bytes per thread\n",
+           threads, all ? "best of 1-16" : acc);
+    /* Powers of two, and half way between */
+    for (bytes = MIN_BYTES; bytes <= MAX_BYTES;
+         bytes = bytes & (bytes - 1) ? bytes/3*4 : bytes/2*3) {
+      const long n = bytes / sizeof(double);
+      printf("%ld", bytes);
+      for (isa = 0; isa < NISA; isa++) {
+        double flops = 0;
+        if (!supported(isa))
+          flops = NAN;
+        else if (!all)
+          flops = reduction(isa, n, accumulators, threads);
+        else /* the best over the number of accumulators */
+          for (c = 1; c <= MAX_CHAINS; c++)
+            flops = fmax(flops, reduction(isa, n, c, threads));
+        printf(" %g", flops);
+      }
+      printf("\n");
+      fflush(stdout);
+    }
+  } else {
+    fprintf(stderr, "Unrecognised MODE: %s\n", argv[1]);
+    return 1;
+  }
+  return 0;
+}
@@ -6,6 +6,8 @@
 #include <limits.h>
 #include <float.h>
 
+#include "../common/bench.h"
+
 #ifdef LIKWID_PERFMON
 #include <likwid.h>
 #else
@@ -23,13 +25,6 @@
 #define MIN(x,y) ((x)<(y)?(x):(y))
 #endif
 
-double getTimeStamp()
-{
-  struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  return (double)ts.tv_sec + (double)ts.tv_nsec * 1.e-9;
-}
-
 #ifndef CSTRIDE
 #define CSTRIDE 64
 #endif
@@ -56,45 +51,52 @@ double transpose(double * restrict b,
   double S, E;
   size_t j;
 
-  S = getTimeStamp();
+  S = bench_timestamp();
   LIKWID_MARKER_START("transpose");
 
   for(j = 0; j < iter; j++) {
     single_transpose(b, a, Nr, Nc);
   }
   LIKWID_MARKER_STOP("transpose");
-  E = getTimeStamp();
+  E = bench_timestamp();
 
   return E-S;
 }
 
-double transpose_test(double * restrict b,
-                      const double * restrict a,
-                      size_t Nr, size_t Nc, size_t iter)
+typedef struct TransposeArgs {
+  double *b;
+  const double *a;
+  size_t Nr, Nc;
+} TransposeArgs;
+
+/* As transpose, but outside the marker region, so that calibration
+ * and the samples don't count */
+static double transpose_bench(void *ctx, size_t reps)
 {
+  TransposeArgs *t = ctx;
   double S, E;
   size_t j;
 
-  S = getTimeStamp();
-  for(j = 0; j < iter; j++) {
-    single_transpose(b, a, Nr, Nc);
+  S = bench_timestamp();
+  for(j = 0; j < reps; j++) {
+    single_transpose(t->b, t->a, t->Nr, t->Nc);
   }
-  E = getTimeStamp();
+  E = bench_timestamp();
 
   return E-S;
 }
 
-
 int main (int argc, char** argv)
 {
   size_t bytesPerWord = sizeof(double);
   size_t Nr = 0;
   size_t Nc = 0;
   size_t i, j;
-  size_t iter = 1;
   double *a, *b;
-  double times[2];
-  double walltime, bytes;
+  double bytes;
+  TransposeArgs args;
+  BenchResult result;
+  char params[64];
 
   if ( argc > 2 ) {
     Nr = atoi(argv[1]);
@@ -116,23 +118,23 @@ int main (int argc, char** argv)
     }
   }
 
-  times[0] = 0.0;
-  times[1] = 0.0;
-
-  while ( times[0] < 0.6 ){
-    double factor;
-    times[0] = transpose_test(b, a, Nr, Nc, iter);
-    if ( times[0] > 0.2 ) break;
-    factor = 0.6 / (times[0] - times[1]);
-    iter *= (int) factor;
-    times[1] = times[0];
-  }
-
-  walltime = transpose(b, a, Nr, Nc, iter);
+  args.b = b;
+  args.a = a;
+  args.Nr = Nr;
+  args.Nc = Nc;
+  bench_run(transpose_bench, &args, &result);
+#ifdef LIKWID_PERFMON
+  /* The marker region counts one pass of as many transposes as a
+   * sample, which the data volumes below are for */
+  transpose(b, a, Nr, Nc, result.reps);
+#endif
 
-  bytes = (double) bytesPerWord * Nc * Nr * iter;
+  bytes = (double) bytesPerWord * Nc * Nr;
   printf("Nrow Ncol EffectiveBW EffectiveLoadMBytes EffectiveStoreMBytes\n");
-  printf("%zu %zu %.2f %.2f %.2f\n", Nr, Nc, 3 * 1.0E-06 * bytes /walltime, 2*bytes*1e-6, bytes*1e-6);
+  printf("%zu %zu %.2f %.2f %.2f\n", Nr, Nc, 3 * 1.0E-06 * bytes /result.median,
+         2*bytes*result.reps*1e-6, bytes*result.reps*1e-6);
+  snprintf(params, sizeof(params), "rows=%zu cols=%zu", Nr, Nc);
+  bench_report("transpose-blocked", params, &result, 3*bytes, "B");
 
   LIKWID_MARKER_CLOSE;
   return EXIT_SUCCESS;
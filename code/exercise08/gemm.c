@@ -7,6 +7,8 @@
 #include <time.h>
 #include <errno.h>
 
+#include "../common/bench.h"
+
 #ifdef LIKWID_PERFMON
 #include <likwid.h>
 #else
@@ -40,7 +42,6 @@ static void basic_gemm(int m, int n, int k,
                        double *c, int ldc)
 {
   int i, j, p;
-  LIKWID_MARKER_START("BASIC_GEMM");
   for (j = 0; j < n; j++) {
     for (p = 0; p < k; p++) {
       for (i = 0; i < m; i++) {
@@ -48,7 +49,6 @@ static void basic_gemm(int m, int n, int k,
       }
     }
   }
-  LIKWID_MARKER_STOP("BASIC_GEMM");
 }
 
 #ifndef TILESIZE
@@ -68,7 +68,6 @@ static void tiled_gemm(int m, int n, int k,
     fprintf(stderr, "Tile size %d must evenly divide matrix dimension %d\n", TILESIZE, m);
     exit(1);
   }
-  LIKWID_MARKER_START("TILED_GEMM");
   for (jj = 0; jj < jlim; jj += TILESIZE) {
     for (pp = 0; pp < plim; pp += TILESIZE) {
       for (ii = 0; ii < ilim; ii += TILESIZE) {
@@ -85,7 +84,6 @@ static void tiled_gemm(int m, int n, int k,
       }
     }
   }
-  LIKWID_MARKER_STOP("TILED_GEMM");
 }
 
 static void tiled_packed_gemm(int m, int n, int k,
@@ -104,7 +102,6 @@ static void tiled_packed_gemm(int m, int n, int k,
     fprintf(stderr, "Tile size %d must evenly divide matrix dimension %d\n", TILESIZE, m);
     exit(1);
   }
-  LIKWID_MARKER_START("TILED_PACKED_GEMM");
   for (jj = 0; jj < jlim; jj += TILESIZE) {
     for (pp = 0; pp < plim; pp += TILESIZE) {
       for (j = 0; j < TILESIZE; j++) {
@@ -143,7 +140,6 @@ static void tiled_packed_gemm(int m, int n, int k,
       }
     }
   }
-  LIKWID_MARKER_STOP("TILED_PACKED_GEMM");
 }
 
 static void alloc_matrix(int m, int n, double **a)
@@ -192,29 +188,43 @@ static void random_matrix(int m, int n, double *a, int lda)
   }
 }
 
-static double diff_time(struct timespec end, struct timespec start)
+typedef struct GemmArgs {
+  gemm_fn_t gemm;
+  int n;
+  const double *a, *b;
+  double *c;
+} GemmArgs;
+
+static double gemm_bench(void *ctx, size_t reps)
 {
-  double secs = (double)end.tv_sec - (double)start.tv_sec;
-  double nsecs = (double)end.tv_nsec - (double)start.tv_nsec;
-  return secs + 1e-9*nsecs;
+  GemmArgs *g = ctx;
+  double start = bench_timestamp();
+  size_t r;
+  for (r = 0; r < reps; r++)
+    g->gemm(g->n, g->n, g->n, g->a, g->n, g->b, g->n, g->c, g->n);
+  return bench_timestamp() - start;
 }
 
 /*
  * Benchmark the provided gemm implementation.
  * n: matrix size
  * gemm: Function pointer to gemm implementation
+ * name: name of the implementation, for the benchmark record
+ * marker: name of the likwid marker region for it
  * prints:
  *  n TIME FLOPs FLOPs/s
+ * where TIME is the median time of one call.
  */
-static void bench(int n, gemm_fn_t gemm)
+static void bench(int n, gemm_fn_t gemm, const char *name, const char *marker)
 {
   double *a = NULL;
   double *b = NULL;
   double *c = NULL;
-  struct timespec start, end;
-  double time, flop;
-  int repeats, i;
+  double flop;
   int lda, ldb, ldc;
+  GemmArgs args;
+  BenchResult result;
+  char params[64];
 
   alloc_matrix(n, n, &a);
   alloc_matrix(n, n, &b);
@@ -229,25 +239,29 @@ static void bench(int n, gemm_fn_t gemm)
   zero_matrix(n, n, c, ldc);
 
   flop = 2.0*(double)n*(double)n*(double)n;
-  time = DBL_MAX;
-    
-  if (n*n < 10000) {
-    /* For small matrices, run in a loop, to help with timing variability. */
-    repeats = 50;
-  } else {
-    repeats = 2;
-  }
 
-  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
-  for (i = 0; i < repeats; i++) {
-    gemm(n, n, n,
-         (const double *)a, lda,
-         (const double *)b, ldb,
-         c, ldc);
+  args.gemm = gemm;
+  args.n = n;
+  args.a = a;
+  args.b = b;
+  args.c = c;
+  bench_run(gemm_bench, &args, &result);
+#ifdef LIKWID_PERFMON
+  {
+    /* The marker region counts one pass of as many calls as a sample,
+     * not the calibration and all the samples */
+    size_t r;
+    LIKWID_MARKER_START(marker);
+    for (r = 0; r < result.reps; r++)
+      gemm(n, n, n, a, lda, b, ldb, c, ldc);
+    LIKWID_MARKER_STOP(marker);
   }
-  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
-  time = diff_time(end, start) / repeats;
-  printf("%d %g %g %g\n", n, time, flop, flop/time);
+#else
+  (void)marker;
+#endif
+  printf("%d %g %g %g\n", n, result.median, flop, flop/result.median);
+  snprintf(params, sizeof(params), "variant=%s n=%d", name, n);
+  bench_report("gemm", params, &result, flop, "FLOP");
   free_matrix(&a);
   free_matrix(&b);
   free_matrix(&c);
@@ -257,6 +271,7 @@ int main(int argc, char **argv)
 {
   int n;
   gemm_fn_t gemm;
+  const char *marker;
   if (argc != 3) {
     fprintf(stderr, "Invalid arguments.\n");
     fprintf(stderr, "Usage: %s N version\n", argv[0]);
@@ -269,10 +284,13 @@ int main(int argc, char **argv)
 
   if (!strcmp(argv[2], "BASIC")) {
     gemm = &basic_gemm;
+    marker = "BASIC_GEMM";
   } else if (!strcmp(argv[2], "TILED")) {
     gemm = &tiled_gemm;
+    marker = "TILED_GEMM";
   } else if (!strcmp(argv[2], "TILEDPACKED")) {
     gemm = &tiled_packed_gemm;
+    marker = "TILED_PACKED_GEMM";
   } else {
     fprintf(stderr, "Unknown GEMM variant '%s'\n", argv[2]);
     return 1;
@@ -282,7 +300,7 @@ int main(int argc, char **argv)
   LIKWID_MARKER_REGISTER("BASIC_GEMM");
   LIKWID_MARKER_REGISTER("TILED_GEMM");
   LIKWID_MARKER_REGISTER("TILED_PACKED_GEMM");
-  bench(n, gemm);
+  bench(n, gemm, argv[2], marker);
   LIKWID_MARKER_CLOSE;
   return 0;
 }
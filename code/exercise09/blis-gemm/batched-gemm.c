@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * Batched GEMM for many small independent products C_b = C_b + A_b*B_b.
+ *
+ * For tiny matrices the blocking and packing in optimised_gemm is pure
+ * overhead: everything already fits in L1. Instead we pick a kernel
+ * whose loop bounds are compile time constants, so the compiler can
+ * fully unroll the p loop and vectorise the i loop without any
+ * remainder handling. Parallelism comes from the batch, not from
+ * inside a single product.
+ */
+
+#include "likwidinc.h"
+
+typedef void (*small_gemm_fn_t)(int, int, int,
+                                const double *, int,
+                                const double *, int,
+                                double *, int);
+
+/*
+ * Different compilers spell "unroll this loop completely" differently.
+ */
+#if defined(__INTEL_COMPILER)
+#define PRAGMA_UNROLL _Pragma("unroll")
+#elif defined(__clang__)
+#define PRAGMA_UNROLL _Pragma("clang loop unroll(full)")
+#elif defined(__GNUC__)
+#define PRAGMA_UNROLL _Pragma("GCC unroll 32")
+#else
+#define PRAGMA_UNROLL
+#endif
+
+/*
+ * Define a kernel for a fixed M x N x K product. The column of C is
+ * held in a local array (which lives in registers after unrolling),
+ * so C is read and written exactly once.
+ */
+#define DEFINE_FIXED_GEMM(M, N, K)                                      \
+  static void gemm_##M##x##N##x##K(int m, int n, int k,                 \
+                                   const double * restrict A, int lda,  \
+                                   const double * restrict B, int ldb,  \
+                                   double * restrict C, int ldc)        \
+  {                                                                     \
+    int i, j, p;                                                        \
+    (void)m; (void)n; (void)k;                                          \
+    for (j = 0; j < N; j++) {                                           \
+      double c[M] __attribute__((aligned(64)));                         \
+      _Pragma("omp simd")                                               \
+        for (i = 0; i < M; i++)                                         \
+          c[i] = C[j*ldc + i];                                          \
+      PRAGMA_UNROLL                                                     \
+        for (p = 0; p < K; p++) {                                       \
+          const double b = B[j*ldb + p];                                \
+          _Pragma("omp simd")                                           \
+            for (i = 0; i < M; i++)                                     \
+              c[i] += A[p*lda + i] * b;                                 \
+        }                                                               \
+      _Pragma("omp simd")                                               \
+        for (i = 0; i < M; i++)                                         \
+          C[j*ldc + i] = c[i];                                          \
+    }                                                                   \
+  }
+
+DEFINE_FIXED_GEMM(4, 4, 4)
+DEFINE_FIXED_GEMM(8, 8, 8)
+DEFINE_FIXED_GEMM(16, 16, 16)
+DEFINE_FIXED_GEMM(32, 32, 32)
+
+/* Fallback for shapes we have no specialised kernel for. Still no
+ * packing, since the operands are assumed to be cache resident. */
+static void gemm_small_generic(int m, int n, int k,
+                               const double * restrict A, int lda,
+                               const double * restrict B, int ldb,
+                               double * restrict C, int ldc)
+{
+  int i, j, p;
+  for (j = 0; j < n; j++) {
+    for (p = 0; p < k; p++) {
+      const double b = B[j*ldb + p];
+#pragma omp simd
+      for (i = 0; i < m; i++)
+        C[j*ldc + i] += A[p*lda + i] * b;
+    }
+  }
+}
+
+static small_gemm_fn_t select_kernel(int m, int n, int k)
+{
+  if (m == n && n == k) {
+    switch (m) {
+    case 4:
+      return &gemm_4x4x4;
+    case 8:
+      return &gemm_8x8x8;
+    case 16:
+      return &gemm_16x16x16;
+    case 32:
+      return &gemm_32x32x32;
+    default:
+      break;
+    }
+  }
+  return &gemm_small_generic;
+}
+
+/*
+ * Compute C[b] = C[b] + A[b]*B[b] for b = 0, ..., batch-1.
+ *
+ * Every problem in the batch has the same shape: C[b] is m x n, A[b]
+ * is m x k and B[b] is k x n, all column major with the given leading
+ * dimensions.
+ */
+void batched_gemm(int m, int n, int k,
+                  const double * const *A, int lda,
+                  const double * const *B, int ldb,
+                  double * const *C, int ldc,
+                  int batch)
+{
+  small_gemm_fn_t kernel = select_kernel(m, n, k);
+  int b;
+
+  LIKWID_MARKER_START("BATCHED_GEMM");
+#pragma omp parallel for schedule(static)
+  for (b = 0; b < batch; b++)
+    kernel(m, n, k, A[b], lda, B[b], ldb, C[b], ldc);
+  LIKWID_MARKER_STOP("BATCHED_GEMM");
+}
+
+/*
+ * As batched_gemm, but matrix b of each operand starts at
+ * X + b*strideX, rather than being given by an array of pointers.
+ */
+void batched_gemm_strided(int m, int n, int k,
+                          const double *A, int lda, long strideA,
+                          const double *B, int ldb, long strideB,
+                          double *C, int ldc, long strideC,
+                          int batch)
+{
+  small_gemm_fn_t kernel = select_kernel(m, n, k);
+  int b;
+
+  LIKWID_MARKER_START("BATCHED_GEMM");
+#pragma omp parallel for schedule(static)
+  for (b = 0; b < batch; b++)
+    kernel(m, n, k,
+           A + b*strideA, lda,
+           B + b*strideB, ldb,
+           C + b*strideC, ldc);
+  LIKWID_MARKER_STOP("BATCHED_GEMM");
+}
@@ -0,0 +1,272 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/*
+ * Runtime selection of the MC, KC, and NC blocking parameters.
+ *
+ * We follow the analytical model of
+ *
+ *   Low, Igual, Smith, and Quintana-Orti, "Analytical modeling is
+ *   enough for high-performance BLIS", ACM TOMS 43(2), 2016.
+ *
+ * Each cache level is treated as W ways of N sets of C byte lines.
+ * - KC: The kc x NR micro-panel of B stays in L1, while MR x kc
+ *   micro-panels of A stream through. A gets C_Ar ways, B gets the
+ *   rest, minus one way for the C tile.
+ * - MC: The mc x kc block of A stays in L2, leaving enough ways for
+ *   the B micro-panel and one for C.
+ * - NC: The kc x nc panel of B stays in (our share of) L3, leaving
+ *   enough ways for the A block and one for C.
+ */
+
+#include "parameters.h"
+#include "blocking.h"
+
+typedef struct {
+  long size;                    /* Bytes */
+  int ways;
+  int line;                     /* Bytes */
+  int shared;                   /* Number of CPUs sharing this cache */
+} cache_info_t;
+
+/* Don't let NC get so large that the packed B buffer is silly, L3
+ * caches on big servers are many hundreds of MB. */
+#define NC_MAX 4096
+
+static cache_info_t caches[3];
+static pthread_once_t caches_once = PTHREAD_ONCE_INIT;
+
+static long read_sysfs_long(const char *dir, const char *file)
+{
+  char path[256];
+  char buf[64];
+  char *end;
+  long val;
+  FILE *f;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, file);
+  f = fopen(path, "r");
+  if (!f)
+    return -1;
+  if (!fgets(buf, sizeof(buf), f)) {
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  val = strtol(buf, &end, 10);
+  if (end == buf)
+    return -1;
+  if (*end == 'K')
+    val *= 1024;
+  else if (*end == 'M')
+    val *= 1024*1024;
+  return val;
+}
+
+/* Count the CPUs in a list like "0-3,8-11" */
+static int read_sysfs_cpu_count(const char *dir, const char *file)
+{
+  char path[256];
+  char buf[1024];
+  char *p;
+  int count = 0;
+  FILE *f;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, file);
+  f = fopen(path, "r");
+  if (!f)
+    return 1;
+  if (!fgets(buf, sizeof(buf), f)) {
+    fclose(f);
+    return 1;
+  }
+  fclose(f);
+  p = buf;
+  while (*p && *p != '\n') {
+    long lo, hi;
+    lo = strtol(p, &p, 10);
+    hi = lo;
+    if (*p == '-')
+      hi = strtol(p + 1, &p, 10);
+    count += hi - lo + 1;
+    if (*p == ',')
+      p++;
+    else
+      break;
+  }
+  return count > 0 ? count : 1;
+}
+
+static void detect_caches(void)
+{
+  int i;
+  memset(caches, 0, sizeof(caches));
+
+  /* Linux exposes everything we need in sysfs. */
+  for (i = 0; i < 8; i++) {
+    char dir[128];
+    char type[32] = {0};
+    long level;
+    FILE *f;
+    snprintf(dir, sizeof(dir), "/sys/devices/system/cpu/cpu0/cache/index%d", i);
+    level = read_sysfs_long(dir, "level");
+    if (level < 1)
+      break;
+    if (level > 3)
+      continue;
+    {
+      char path[160];
+      snprintf(path, sizeof(path), "%s/type", dir);
+      f = fopen(path, "r");
+      if (!f || !fgets(type, sizeof(type), f)) {
+        if (f)
+          fclose(f);
+        continue;
+      }
+      fclose(f);
+    }
+    if (!strncmp(type, "Instruction", 11))
+      continue;
+    caches[level-1].size = read_sysfs_long(dir, "size");
+    caches[level-1].ways = read_sysfs_long(dir, "ways_of_associativity");
+    caches[level-1].line = read_sysfs_long(dir, "coherency_line_size");
+    caches[level-1].shared = read_sysfs_cpu_count(dir, "shared_cpu_list");
+  }
+
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+  /* Fall back to glibc's view if sysfs is not available. */
+  if (caches[0].size <= 0) {
+    caches[0].size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    caches[0].ways = sysconf(_SC_LEVEL1_DCACHE_ASSOC);
+    caches[0].line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    caches[0].shared = 1;
+  }
+  if (caches[1].size <= 0) {
+    caches[1].size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    caches[1].ways = sysconf(_SC_LEVEL2_CACHE_ASSOC);
+    caches[1].line = sysconf(_SC_LEVEL2_CACHE_LINESIZE);
+    caches[1].shared = 1;
+  }
+  if (caches[2].size <= 0) {
+    caches[2].size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    caches[2].ways = sysconf(_SC_LEVEL3_CACHE_ASSOC);
+    caches[2].line = sysconf(_SC_LEVEL3_CACHE_LINESIZE);
+    caches[2].shared = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+#endif
+  for (i = 0; i < 3; i++) {
+    if (caches[i].shared < 1)
+      caches[i].shared = 1;
+  }
+}
+
+static int cache_valid(const cache_info_t *c)
+{
+  return c->size > 0 && c->ways > 1 && c->line > 0;
+}
+
+static int ceil_div(long a, long b)
+{
+  return (a + b - 1) / b;
+}
+
+static int env_override(const char *name, int value)
+{
+  const char *env = getenv(name);
+  if (env && atoi(env) > 0)
+    return atoi(env);
+  return value;
+}
+
+static void compute_blocking(int mr, int nr, int size, gemm_blocking_t *b)
+{
+  const cache_info_t *l1 = &caches[0];
+  const cache_info_t *l2 = &caches[1];
+  const cache_info_t *l3 = &caches[2];
+
+  b->mc = MC;
+  b->kc = KC;
+  b->nc = NC;
+
+  if (cache_valid(l1)) {
+    long sets = l1->size / (l1->ways * l1->line);
+    int car = (int)((l1->ways - 1) / (1.0 + (double)nr / mr));
+    if (car < 1)
+      car = 1;
+    b->kc = (int)(car * sets * l1->line / ((long)mr * size));
+  }
+  if (cache_valid(l2)) {
+    long sets = l2->size / (l2->ways * l2->line);
+    int cac = l2->ways - 1 - ceil_div((long)b->kc * nr * size, sets * l2->line);
+    if (cac < 1)
+      cac = 1;
+    b->mc = (int)(cac * sets * l2->line / ((long)b->kc * size));
+    b->mc = (b->mc / mr) * mr;
+    if (b->mc < mr)
+      b->mc = mr;
+  }
+  if (cache_valid(l3)) {
+    /* Only our share of a shared L3 is available. */
+    long bytes = l3->size / l3->shared;
+    long sets = bytes / (l3->ways * l3->line);
+    int cbc = l3->ways - 1 - ceil_div((long)b->mc * b->kc * size, sets * l3->line);
+    if (cbc < 1)
+      cbc = 1;
+    if (sets > 0) {
+      long nc = cbc * sets * l3->line / ((long)b->kc * size);
+      b->nc = nc > NC_MAX ? NC_MAX : (int)nc;
+      b->nc = (b->nc / nr) * nr;
+      if (b->nc < nr)
+        b->nc = nr;
+    }
+  }
+
+  b->mc = env_override("GEMM_MC", b->mc);
+  b->kc = env_override("GEMM_KC", b->kc);
+  b->nc = env_override("GEMM_NC", b->nc);
+
+  if (getenv("GEMM_VERBOSE")) {
+    fprintf(stderr, "gemm blocking (MR=%d NR=%d size=%d): MC=%d KC=%d NC=%d\n",
+            mr, nr, size, b->mc, b->kc, b->nc);
+  }
+}
+
+#define MAX_BLOCKINGS 8
+
+static struct {
+  int mr, nr, size;
+  gemm_blocking_t blocking;
+} blockings[MAX_BLOCKINGS];
+static int nblockings = 0;
+static pthread_mutex_t blockings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const gemm_blocking_t *gemm_blocking(int mr, int nr, int size)
+{
+  const gemm_blocking_t *result = NULL;
+  int i;
+
+  pthread_once(&caches_once, &detect_caches);
+  pthread_mutex_lock(&blockings_lock);
+  for (i = 0; i < nblockings; i++) {
+    if (blockings[i].mr == mr && blockings[i].nr == nr && blockings[i].size == size) {
+      result = &blockings[i].blocking;
+      break;
+    }
+  }
+  if (!result) {
+    if (nblockings == MAX_BLOCKINGS) {
+      fprintf(stderr, "Too many distinct gemm blockings requested\n");
+      exit(1);
+    }
+    blockings[nblockings].mr = mr;
+    blockings[nblockings].nr = nr;
+    blockings[nblockings].size = size;
+    compute_blocking(mr, nr, size, &blockings[nblockings].blocking);
+    result = &blockings[nblockings++].blocking;
+  }
+  pthread_mutex_unlock(&blockings_lock);
+  return result;
+}
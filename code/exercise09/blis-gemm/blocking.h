@@ -0,0 +1,19 @@
+#pragma once
+
+/*
+ * Cache blocking parameters for the packed gemm.
+ * mc x kc is the block of A that is packed (and lives in L2).
+ * kc x nc is the block of B that is packed (and lives in L3).
+ */
+typedef struct {
+  int mc;
+  int kc;
+  int nc;
+} gemm_blocking_t;
+
+/*
+ * Return the blocking parameters for a micro-kernel of size mr x nr
+ * operating on elements of size bytes. Computed once per distinct
+ * (mr, nr, size) and cached.
+ */
+const gemm_blocking_t *gemm_blocking(int mr, int nr, int size);
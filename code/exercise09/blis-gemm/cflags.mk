@@ -1,5 +1,7 @@
 # These flags are for Intel, GCC/Clang may need different ones
 CC = icc
 CFLAGS := -O3 -xBROADWELL -ffast-math
+# GCC/Clang: -fopenmp
+OMPFLAGS := -qopenmp
 USE_LIKWID = No
 USE_OPENBLAS = No
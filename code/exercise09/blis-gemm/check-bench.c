@@ -0,0 +1,325 @@
+/*
+ * Checking and benchmarking, written once for all element types.
+ * gemm.c includes this file once per type, after defining
+ *
+ *   FLOAT            the element type
+ *   REAL             the real type of the same precision
+ *   FN(f)            the name of function f for this type
+ *   EPSILON          machine epsilon for REAL
+ *   ABS(x)           absolute value of a FLOAT
+ *   RANDOM()         a random FLOAT with entries in [0, 1)
+ *   RANDOM_SIGNED()  a random FLOAT with entries in [-1, 1)
+ *   FLOP_PER_FMA     real flops in one multiply-add c += a*b
+ *   GAMMA_EXTRA      extra terms in the error constant of an inner
+ *                    product, gamma_{n + GAMMA_EXTRA}
+ *   MAX_PRODUCT      bound on |a*b| for a, b from RANDOM()
+ */
+
+typedef void (*FN(gemm_fn_t))(int, int, int,
+                              const FLOAT *, int,
+                              const FLOAT *, int,
+                              FLOAT *, int);
+
+/* Compute C = C + A*B
+ *
+ * C has rank m x n (m rows, n columns)
+ * A has rank m x k
+ * B has rank k x n
+ * ldX is the leading dimension of the respective matrix.
+ *
+ * All matrices are stored in column major format.
+ * That is, for row index i, column index j, and leading dimension ldX,
+ * the correct entry is at (ldX*i + j).
+ */
+static void FN(basic_gemm)(int m, int n, int k,
+                           const FLOAT *a, int lda,
+                           const FLOAT *b, int ldb,
+                           FLOAT *c, int ldc)
+{
+  int i, j, p;
+  LIKWID_MARKER_START("BASIC_GEMM");
+  for (j = 0; j < n; j++) {
+    for (p = 0; p < k; p++) {
+      for (i = 0; i < m; i++) {
+        c[j*ldc + i] = c[j*ldc + i] + a[p*lda + i] * b[j*ldb + p];
+      }
+    }
+  }
+  LIKWID_MARKER_STOP("BASIC_GEMM");
+}
+
+void FN(alloc_matrix)(int m, int n, FLOAT **a)
+{
+  *a = alloc_aligned((size_t)m*n*sizeof(**a));
+}
+
+void FN(free_matrix)(FLOAT **a)
+{
+  free(*a);
+  *a = NULL;
+}
+
+static void FN(zero_matrix)(int m, int n, FLOAT *a, int lda)
+{
+  int i, j;
+  for (j = 0; j < n; j++) {
+    for (i = 0; i < m; i++) {
+      a[j*lda + i] = 0.0;
+    }
+  }
+}
+
+static void FN(random_matrix)(int m, int n, FLOAT *a, int lda)
+{
+  int i, j;
+  for (j = 0; j < n; j++) {
+    for (i = 0; i < m; i++) {
+      a[j*lda + i] = RANDOM();
+    }
+  }
+}
+
+/*
+ * Matrix-vector product y = A*x, and yabs = |A|*|x|.
+ * A has rank m x n.
+ */
+static void FN(matvec)(int m, int n, const FLOAT *a, int lda,
+                       const FLOAT *x, const REAL *xabs,
+                       FLOAT *y, REAL *yabs)
+{
+  int i, j;
+  for (i = 0; i < m; i++) {
+    y[i] = 0.0;
+    yabs[i] = 0.0;
+  }
+  for (j = 0; j < n; j++) {
+    for (i = 0; i < m; i++) {
+      y[i] += a[j*lda + i] * x[j];
+      yabs[i] += ABS(a[j*lda + i]) * xabs[j];
+    }
+  }
+}
+
+/*
+ * Freivalds-style check that C = A*B, in O(mn + mk + kn) rather
+ * than O(mnk). For a random vector x compare w = C*x with z = A*(B*x).
+ *
+ * If C was computed with a classical (not Strassen) algorithm, then
+ * |C - AB| <= gamma_k |A||B|, and accounting for the rounding in the
+ * three matrix-vector products gives, to first order,
+ *
+ *   |w - z| <= (2 gamma_k + gamma_n) |A|(|B||x|) + gamma_n |C||x|
+ *
+ * componentwise. We fail if any component violates this bound. For
+ * non-classical algorithms the first gamma_k is scaled by slack.
+ * maxdiff is set to the largest |w - z|.
+ * Returns 1 if the check failed, 0 if it passed.
+ */
+static int FN(check_randomised)(int m, int n, int k,
+                                const FLOAT *a, int lda,
+                                const FLOAT *b, int ldb,
+                                const FLOAT *c, int ldc,
+                                double slack, double *maxdiff)
+{
+  FLOAT *x, *y, *z, *w;
+  REAL *xabs, *yabs, *zabs, *wabs;
+  const double gk = gamma_n(k + GAMMA_EXTRA, EPSILON);
+  const double gn = gamma_n(n + GAMMA_EXTRA, EPSILON);
+  const double ga = slack*gk + gk + gn;
+  const double gc = gn;
+  int failed = 0;
+  int i, t;
+
+  FN(alloc_matrix)(n, 1, &x);
+  FN(alloc_matrix)(k, 1, &y);
+  FN(alloc_matrix)(m, 1, &z);
+  FN(alloc_matrix)(m, 1, &w);
+  xabs = alloc_aligned(n*sizeof(*xabs));
+  yabs = alloc_aligned(k*sizeof(*yabs));
+  zabs = alloc_aligned(m*sizeof(*zabs));
+  wabs = alloc_aligned(m*sizeof(*wabs));
+
+  *maxdiff = 0;
+  for (t = 0; t < CHECK_NVEC && !failed; t++) {
+    for (i = 0; i < n; i++) {
+      x[i] = RANDOM_SIGNED();
+      xabs[i] = ABS(x[i]);
+    }
+    FN(matvec)(k, n, b, ldb, x, xabs, y, yabs);
+    FN(matvec)(m, k, a, lda, y, yabs, z, zabs);
+    FN(matvec)(m, n, c, ldc, x, xabs, w, wabs);
+    for (i = 0; i < m; i++) {
+      double diff = ABS(w[i] - z[i]);
+      double bound = ga*zabs[i] + gc*wabs[i];
+      if (diff != diff) {
+        *maxdiff = diff;
+        failed = 1;
+        break;
+      }
+      *maxdiff = fmax(*maxdiff, diff);
+      if (diff > bound) {
+        failed = 1;
+      }
+    }
+  }
+
+  FN(free_matrix)(&x);
+  FN(free_matrix)(&y);
+  FN(free_matrix)(&z);
+  FN(free_matrix)(&w);
+  free(xabs);
+  free(yabs);
+  free(zabs);
+  free(wabs);
+  return failed;
+}
+
+/*
+ * Check that a matrix matches the result of multiplication with
+ * "basic" implementation. For large matrices, use the randomised
+ * check instead.
+ * m, n, k: size of matrices to check.
+ * C has rank m x n (m rows, n columns)
+ * A has rank m x k
+ * B has rank k x n
+ * gemm: function pointer to gemm implementation.
+ * slack: factor by which the error is allowed to exceed that of a
+ *        classical gemm (1 unless gemm is not a classical algorithm).
+ * Both results have errors of at most gamma_k |A||B|, and the entries
+ * of |A||B| are at most k MAX_PRODUCT, so they may differ by
+ * (slack + 1) gamma_k k MAX_PRODUCT.
+ * Returns 1 if the check failed, 0 if it passed.
+ */
+static int FN(check)(int m, int n, int k, FN(gemm_fn_t) gemm, double slack,
+                     double *maxdiff)
+{
+  FLOAT *a = NULL;
+  FLOAT *b = NULL;
+  FLOAT *copt = NULL;
+  FLOAT *cbasic = NULL;
+  const double tol = (slack + 1)*gamma_n(k + GAMMA_EXTRA, EPSILON)*k*MAX_PRODUCT;
+  int failed;
+  int i, j;
+  int lda, ldb, ldc;
+  *maxdiff = -1;
+
+  FN(alloc_matrix)(m, k, &a);
+  FN(alloc_matrix)(k, n, &b);
+  FN(alloc_matrix)(m, n, &copt);
+
+  lda = m;
+  ldb = k;
+  ldc = m;
+
+  FN(random_matrix)(m, k, a, lda);
+  FN(random_matrix)(k, n, b, ldb);
+  FN(zero_matrix)(m, n, copt, ldc);
+
+  gemm(m, n, k, a, lda, b, ldb, copt, ldc);
+
+  if ((double)m*n*k > EXACT_CHECK_LIMIT) {
+    failed = FN(check_randomised)(m, n, k, a, lda, b, ldb, copt, ldc, slack, maxdiff);
+    goto done;
+  }
+
+  FN(alloc_matrix)(m, n, &cbasic);
+  FN(zero_matrix)(m, n, cbasic, ldc);
+  FN(basic_gemm)(m, n, k, a, lda, b, ldb, cbasic, ldc);
+
+  for (j = 0; j < n; j++) {
+    for (i = 0; i < m; i++) {
+      double diff = ABS(copt[j*ldc + i] - cbasic[j*ldc + i]);
+      if (diff != diff) {
+        *maxdiff = diff;
+        goto compared;
+      } else {
+        *maxdiff = fmax(*maxdiff, diff);
+      }
+    }
+  }
+ compared:
+  failed = (*maxdiff > tol) || (*maxdiff != *maxdiff);
+  FN(free_matrix)(&cbasic);
+ done:
+  FN(free_matrix)(&a);
+  FN(free_matrix)(&b);
+  FN(free_matrix)(&copt);
+  return failed;
+}
+
+typedef struct FN(GemmArgs) {
+  FN(gemm_fn_t) gemm;
+  int m, n, k;
+  const FLOAT *a, *b;
+  FLOAT *c;
+  double total;
+} FN(GemmArgs);
+
+static double FN(gemm_bench)(void *ctx, size_t reps)
+{
+  FN(GemmArgs) *g = ctx;
+  double start = bench_timestamp(), time;
+  size_t r;
+  for (r = 0; r < reps; r++)
+    g->gemm(g->m, g->n, g->k, g->a, g->m, g->b, g->k, g->c, g->m);
+  time = bench_timestamp() - start;
+  g->total += time;
+  return time;
+}
+
+/*
+ * Benchmark the provided gemm implementation.
+ * m, n, k: matrix sizes C[m, n] = C[m, n] + A[m, k]*B[k, n]
+ * gemm: Function pointer to gemm implementation
+ * mode: the mode it was run in, for the benchmark record
+ * prints:
+ *  m n k TIME FLOP FLOP/s PACK
+ * where TIME is the median time of one call, PACK is the fraction of
+ * the time spent packing in optimised_gemm, and FLOP counts real
+ * flops (FLOP_PER_FMA per multiply-add).
+ */
+static void FN(bench)(int m, int n, int k, FN(gemm_fn_t) gemm, const char *mode)
+{
+  FLOAT *a = NULL;
+  FLOAT *b = NULL;
+  FLOAT *c = NULL;
+  double flop, packtime, gemmtime;
+  int lda, ldb, ldc;
+  FN(GemmArgs) args;
+  BenchResult result;
+  char name[64], params[64];
+
+  FN(alloc_matrix)(m, k, &a);
+  FN(alloc_matrix)(k, n, &b);
+  FN(alloc_matrix)(m, n, &c);
+
+  lda = m;
+  ldb = k;
+  ldc = m;
+
+  FN(random_matrix)(m, k, a, lda);
+  FN(random_matrix)(k, n, b, ldb);
+  FN(zero_matrix)(m, n, c, ldc);
+
+  flop = FLOP_PER_FMA*(double)m*(double)n*(double)k;
+
+  args.gemm = gemm;
+  args.m = m;
+  args.n = n;
+  args.k = k;
+  args.a = a;
+  args.b = b;
+  args.c = c;
+  args.total = 0;
+  optimised_gemm_reset_timers();
+  bench_run(FN(gemm_bench), &args, &result);
+  optimised_gemm_timers(&packtime, &gemmtime);
+  printf("%d %d %d %g %g %g %g\n", m, n, k, result.median, flop, flop/result.median,
+         packtime / args.total);
+  snprintf(name, sizeof(name), "gemm/%s", mode);
+  snprintf(params, sizeof(params), "m=%d n=%d k=%d", m, n, k);
+  bench_report(name, params, &result, flop, "FLOP");
+  FN(free_matrix)(&a);
+  FN(free_matrix)(&b);
+  FN(free_matrix)(&c);
+}
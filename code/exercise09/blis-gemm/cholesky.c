@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+/*
+ * Tiled Cholesky factorisation A = L L^T of a symmetric positive
+ * definite matrix, on top of the packed gemm kernels.
+ *
+ * A is split into nb x nb tiles. For each tile column k the right
+ * looking algorithm does
+ *
+ *   POTRF: A(k, k) = L(k, k) L(k, k)^T
+ *   TRSM:  A(i, k) = A(i, k) L(k, k)^-T           for i > k
+ *   SYRK:  A(i, i) = A(i, i) - A(i, k) A(i, k)^T  for i > k
+ *   GEMM:  A(i, j) = A(i, j) - A(i, k) A(j, k)^T  for k < j < i
+ *
+ * Each of these is an OpenMP task, with dependencies on the tiles it
+ * reads and writes, so the updates from step k overlap with the
+ * factorisation of later tile columns. SYRK and GEMM, and most of the
+ * flops in TRSM, go through optimised_syrk and optimised_gemm_nt,
+ * which pack with pack_A and a transposing pack_B, and run the micro
+ * kernel. SYRK only computes tiles touching the lower triangle.
+ *
+ * Only the lower triangle of A is referenced or overwritten.
+ */
+
+#include "likwidinc.h"
+
+/* Width of the column blocks in the tile TRSM and POTRF */
+#ifndef CHOLESKY_INNER_BLOCK
+#define CHOLESKY_INNER_BLOCK 32
+#endif
+
+void optimised_gemm_nt(int, int, int,
+                       const double *, int,
+                       const double *, int,
+                       double *, int,
+                       double);
+
+void optimised_syrk(int, int,
+                    const double *, int,
+                    double *, int,
+                    double);
+
+/*
+ * Unblocked Cholesky of the n x n lower triangle of A.
+ * Returns 0 on success, or j+1 if the leading minor of order j+1 is
+ * not positive definite.
+ */
+static int potrf_unblocked(int n, double *A, int lda)
+{
+  int i, j, p;
+  for (j = 0; j < n; j++) {
+    double d = A[j*lda + j];
+    for (p = 0; p < j; p++)
+      d -= A[p*lda + j] * A[p*lda + j];
+    if (!(d > 0))
+      return j + 1;
+    d = sqrt(d);
+    A[j*lda + j] = d;
+    for (p = 0; p < j; p++) {
+      const double ljp = A[p*lda + j];
+      for (i = j + 1; i < n; i++)
+        A[j*lda + i] -= A[p*lda + i] * ljp;
+    }
+    for (i = j + 1; i < n; i++)
+      A[j*lda + i] /= d;
+  }
+  return 0;
+}
+
+/*
+ * Solve X L^T = B for X, overwriting the m x n matrix B, where L is
+ * n x n lower triangular. Column blocks of X are finished one at a
+ * time, the update of the remaining columns is a gemm.
+ */
+static void trsm_rlt(int m, int n, const double *L, int ldl,
+                     double *B, int ldb)
+{
+  int i, j, p, q;
+  for (q = 0; q < n; q += CHOLESKY_INNER_BLOCK) {
+    int w = n - q < CHOLESKY_INNER_BLOCK ? n - q : CHOLESKY_INNER_BLOCK;
+    /* B(:, q:q+w) -= X(:, 0:q) L(q:q+w, 0:q)^T */
+    if (q > 0)
+      optimised_gemm_nt(m, w, q, B, ldb, &L[q], ldl, &B[q*ldb], ldb, -1.0);
+    /* Triangular solve with the diagonal block */
+    for (j = q; j < q + w; j++) {
+      const double d = 1.0 / L[j*ldl + j];
+      for (p = q; p < j; p++) {
+        const double ljp = L[p*ldl + j];
+        for (i = 0; i < m; i++)
+          B[j*ldb + i] -= B[p*ldb + i] * ljp;
+      }
+      for (i = 0; i < m; i++)
+        B[j*ldb + i] *= d;
+    }
+  }
+}
+
+/*
+ * Cholesky of a diagonal tile. Blocked in the same way as the full
+ * factorisation, but sequentially.
+ * Returns 0 on success, or the order of the leading minor that is not
+ * positive definite.
+ */
+static int potrf_tile(int n, double *A, int lda)
+{
+  int q, info;
+  for (q = 0; q < n; q += CHOLESKY_INNER_BLOCK) {
+    int w = n - q < CHOLESKY_INNER_BLOCK ? n - q : CHOLESKY_INNER_BLOCK;
+    double *Aqq = &A[q*lda + q];
+    if (q > 0)
+      optimised_syrk(w, q, &A[q], lda, Aqq, lda, -1.0);
+    info = potrf_unblocked(w, Aqq, lda);
+    if (info)
+      return q + info;
+    if (q + w < n) {
+      /* Update the rest of the block column, then solve */
+      if (q > 0)
+        optimised_gemm_nt(n - q - w, w, q, &A[q + w], lda, &A[q], lda,
+                          &A[q*lda + q + w], lda, -1.0);
+      trsm_rlt(n - q - w, w, Aqq, lda, &A[q*lda + q + w], lda);
+    }
+  }
+  return 0;
+}
+
+/*
+ * Factorise the n x n symmetric positive definite matrix A = L L^T,
+ * overwriting the lower triangle of A with L, using nb x nb tiles.
+ * Call from outside a parallel region, the tasks run on all OpenMP
+ * threads.
+ * Returns 0 on success, or (as LAPACK's dpotrf) the order of the
+ * leading minor that is not positive definite.
+ */
+int cholesky(int n, double *A, int lda, int nb)
+{
+  int nt = (n + nb - 1) / nb;
+  int info = 0;
+  int i, j, k;
+
+  LIKWID_MARKER_START("CHOLESKY");
+#pragma omp parallel
+#pragma omp single
+  for (k = 0; k < nt; k++) {
+    const int kk = k*nb;
+    const int bk = n - kk < nb ? n - kk : nb;
+    double *Akk = &A[(size_t)kk*lda + kk];
+
+#pragma omp task depend(inout: Akk[0]) shared(info)
+    {
+      int tinfo;
+#pragma omp atomic read
+      tinfo = info;
+      if (!tinfo) {
+        tinfo = potrf_tile(bk, Akk, lda);
+        if (tinfo) {
+#pragma omp atomic write
+          info = kk + tinfo;
+        }
+      }
+    }
+
+    for (i = k + 1; i < nt; i++) {
+      const int ii = i*nb;
+      const int bi = n - ii < nb ? n - ii : nb;
+      double *Aik = &A[(size_t)kk*lda + ii];
+#pragma omp task depend(in: Akk[0]) depend(inout: Aik[0]) shared(info)
+      {
+        int tinfo;
+#pragma omp atomic read
+        tinfo = info;
+        if (!tinfo)
+          trsm_rlt(bi, bk, Akk, lda, Aik, lda);
+      }
+    }
+
+    for (i = k + 1; i < nt; i++) {
+      const int ii = i*nb;
+      const int bi = n - ii < nb ? n - ii : nb;
+      double *Aik = &A[(size_t)kk*lda + ii];
+      double *Aii = &A[(size_t)ii*lda + ii];
+      for (j = k + 1; j < i; j++) {
+        const int jj = j*nb;
+        double *Ajk = &A[(size_t)kk*lda + jj];
+        double *Aij = &A[(size_t)jj*lda + ii];
+#pragma omp task depend(in: Aik[0], Ajk[0]) depend(inout: Aij[0])
+        optimised_gemm_nt(bi, nb, bk, Aik, lda, Ajk, lda, Aij, lda, -1.0);
+      }
+#pragma omp task depend(in: Aik[0]) depend(inout: Aii[0])
+      optimised_syrk(bi, bk, Aik, lda, Aii, lda, -1.0);
+    }
+  }
+  LIKWID_MARKER_STOP("CHOLESKY");
+  return info;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+/*
+ * Post-processing fused into the write-back of C. With an epilogue,
+ * the gemm computes
+ *
+ *   C(i, j) = clamp(alpha*(C(i, j) + (A*B)(i, j)) + row_bias[i] + col_bias[j],
+ *                   lo, hi)
+ *
+ * one MR x NR tile at a time, while the tile is still in cache. Either
+ * bias may be NULL. For ReLU set lo = 0 and hi = INFINITY, for no
+ * clamping lo = -INFINITY and hi = INFINITY.
+ */
+typedef struct {
+  double alpha;
+  const double *row_bias;       /* m entries, or NULL */
+  const double *col_bias;       /* n entries, or NULL */
+  double lo;
+  double hi;
+} gemm_epilogue_t;
+
+/* The same for optimised_sgemm_epilogue */
+typedef struct {
+  float alpha;
+  const float *row_bias;
+  const float *col_bias;
+  float lo;
+  float hi;
+} sgemm_epilogue_t;
@@ -0,0 +1,9 @@
+/*
+ * The micro kernel from the exercise (../micro-kernel.c), built on its
+ * own so that kernel-bench can measure it with whatever MR and NR it
+ * was given.
+ */
+#include "../micro-kernel.c"
+
+const int exercise_mr = MR;
+const int exercise_nr = NR;
@@ -0,0 +1,574 @@
+/*
+ * The packing and blocking skeleton of optimised_gemm, written once
+ * for all element types. optimised-gemm.c includes this file once per
+ * type, after defining
+ *
+ *   FLOAT            the element type
+ *   GEMM_NAME        the name of the public gemm function
+ *   GEMM_FN(f)       the name of the internal function f for this type
+ *   GEMM_MR          rows of C updated by the micro kernel
+ *   GEMM_NR          columns of C updated by the micro kernel
+ *   GEMM_CL          elements per cache line
+ *   GEMM_MARKER      the likwid marker region name
+ *   GEMM_EPILOGUE_T  the epilogue type (see epilogue.h)
+ *
+ * and, for complex types, GEMM_COMPLEX and GEMM_REAL (the real type
+ * of the same precision), which select the complex micro kernels.
+ * Real types also define GEMM_EPILOGUE_NAME, the name of the gemm
+ * with an epilogue. Complex types have no epilogue, and set
+ * GEMM_EPILOGUE_T to void. If GEMM_NT_NAME and GEMM_SYRK_NAME are
+ * defined, we also provide C = C + alpha*A*B^T and its lower
+ * triangular special case C = C + alpha*A*A^T, for cholesky.c.
+ *
+ * The micro kernel (micro-kernel.c) is instantiated alongside.
+ */
+
+static void GEMM_FN(pack_A_full)(int k,
+                                 const FLOAT * restrict A, int lda,
+                                 FLOAT * restrict buffer)
+{
+  int i, j;
+
+  for (j = 0; j < k; ++j) {
+    /* Columns of A are lda apart, so the hardware prefetcher won't
+     * find them. Prefetching past the end is harmless. */
+    for (i = 0; i < GEMM_MR; i += GEMM_CL)
+      __builtin_prefetch(&A[i + (j + PACK_PREFETCH_DIST)*lda]);
+    for (i = 0; i < GEMM_MR; ++i)
+      buffer[i + j*GEMM_MR] = A[i + j*lda];
+  }
+}
+
+static void GEMM_FN(pack_A)(int m, int k,
+                            const FLOAT * restrict A, int lda,
+                            FLOAT * restrict buffer)
+{
+  int i, j;
+  int mp  = m / GEMM_MR;
+  int _mr = m % GEMM_MR;
+
+  for (i = 0; i < mp; ++i) {
+    /* Pack A, in row strips MR x k, column major order. */
+    GEMM_FN(pack_A_full)(k, A, lda, buffer);
+    buffer += k*GEMM_MR;
+    A += GEMM_MR;
+  }
+  if (_mr) {
+    /* Cleanup code for non-full tile */
+    for (j = 0; j < k; ++j) {
+      for (i = 0; i < _mr; ++i)
+        buffer[i] = A[i];
+      for (i = _mr; i < GEMM_MR; ++i)
+        buffer[i] = 0.0;
+      buffer += GEMM_MR;
+      A += lda;
+    }
+  }
+}
+
+static void GEMM_FN(pack_B_full)(int k,
+                                 const FLOAT * restrict B, int ldb,
+                                 FLOAT * restrict buffer)
+{
+  int i, j;
+
+  for (i = 0; i < k; ++i) {
+    /* We walk down NR columns at once, prefetch ahead in each. */
+    if (!(i % GEMM_CL))
+      for (j = 0; j < GEMM_NR; ++j)
+        __builtin_prefetch(&B[j*ldb + i + PACK_PREFETCH_DIST*GEMM_CL]);
+    for (j = 0; j < GEMM_NR; ++j)
+      buffer[j + i*GEMM_NR] = B[j*ldb + i];
+  }
+}
+
+static void GEMM_FN(pack_B)(int k, int n,
+                            const FLOAT * restrict B, int ldb,
+                            FLOAT * restrict buffer)
+{
+  int i, j;
+  int np  = n / GEMM_NR;
+  int _nr = n % GEMM_NR;
+
+  for (j = 0; j < np; ++j) {
+    /* Pack B, in column strips kc x NR, row major order. */
+    GEMM_FN(pack_B_full)(k, B, ldb, buffer);
+    buffer += k*GEMM_NR;
+    B += GEMM_NR*ldb;
+  }
+  
+  if (_nr) {
+    /* Cleanup code for non full tile. */
+    for (i = 0; i < k; ++i) {
+      for (j = 0; j < _nr; ++j)
+        buffer[j] = B[j*ldb];
+      for (j = _nr; j < GEMM_NR; ++j)
+        buffer[j] = 0.0;
+      buffer += GEMM_NR;
+      B += 1;
+    }
+  }
+}
+
+#ifdef GEMM_NT_NAME
+/*
+ * Pack alpha*B^T, where B is n x k, in the layout of pack_B. Row j of
+ * B is column j of B^T, so this is pack_A with NR wide strips.
+ */
+static void GEMM_FN(pack_Bt)(int k, int n,
+                             const FLOAT * restrict B, int ldb,
+                             FLOAT * restrict buffer, FLOAT alpha)
+{
+  int i, j, l;
+
+  for (j = 0; j < n; j += GEMM_NR) {
+    int nr = n - j < GEMM_NR ? n - j : GEMM_NR;
+    for (l = 0; l < k; ++l) {
+      for (i = 0; i < nr; ++i)
+        buffer[i] = alpha*B[j + i + l*ldb];
+      for (i = nr; i < GEMM_NR; ++i)
+        buffer[i] = 0.0;
+      buffer += GEMM_NR;
+    }
+  }
+}
+#endif
+
+#include "micro-kernel.c"
+
+#ifndef GEMM_COMPLEX
+/*
+ * Apply the epilogue to an m x n tile of C, whose top left entry is
+ * C(row, col).
+ */
+static inline void GEMM_FN(tile_epilogue)(int m, int n,
+                                          FLOAT * restrict C, int ldc,
+                                          const GEMM_EPILOGUE_T *ep,
+                                          int row, int col)
+{
+  const FLOAT alpha = ep->alpha;
+  const FLOAT lo = ep->lo;
+  const FLOAT hi = ep->hi;
+  const FLOAT * restrict rb = ep->row_bias ? ep->row_bias + row : NULL;
+  const FLOAT * restrict cb = ep->col_bias ? ep->col_bias + col : NULL;
+  int i, j;
+
+  for (j = 0; j < n; ++j) {
+    const FLOAT b = cb ? cb[j] : 0;
+    FLOAT *c = &C[j*ldc];
+    if (rb) {
+      for (i = 0; i < m; ++i) {
+        FLOAT x = alpha*c[i] + b + rb[i];
+        x = x < lo ? lo : x;
+        c[i] = x > hi ? hi : x;
+      }
+    } else {
+      for (i = 0; i < m; ++i) {
+        FLOAT x = alpha*c[i] + b;
+        x = x < lo ? lo : x;
+        c[i] = x > hi ? hi : x;
+      }
+    }
+  }
+}
+#endif
+
+/*
+ * Multiply the packed mc x kc block of A into the packed kc x nc
+ * block of B, and add the result into C, which is C(row, col) of the
+ * full matrix.
+ * If ep is not NULL, this is the last block of k: apply the epilogue
+ * to each tile as soon as it is complete.
+ * If lower is set, only update the lower triangle of the full C, and
+ * skip tiles that lie entirely above the diagonal.
+ */
+static void GEMM_FN(macro_kernel)(int mc, int nc, int kc,
+                                  FLOAT * restrict _A,
+                                  FLOAT * restrict _B,
+                                  FLOAT * restrict C, int ldc,
+                                  const GEMM_EPILOGUE_T *ep,
+                                  int row, int col, int lower)
+{
+  int i, j;
+  int mp = (mc+GEMM_MR-1) / GEMM_MR;
+  int np = (nc+GEMM_NR-1) / GEMM_NR;
+
+  int _mr = mc % GEMM_MR;
+  int _nr = nc % GEMM_NR;
+
+
+  for (j = 0; j < np; ++j) {
+    /* Only the last iteration might not be a full tile */
+    int nr = (j != np-1 || _nr == 0) ? GEMM_NR : _nr;
+
+    for (i = 0; i < mp; ++i) {
+      int k, l;
+      int mr = (i != mp-1 || _mr == 0) ? GEMM_MR : _mr;
+      int r0 = row + i*GEMM_MR;
+      int c0 = col + j*GEMM_NR;
+      /* Does the tile cross the diagonal? */
+      int partial = lower && r0 < c0 + nr - 1;
+      FLOAT *Cij = &C[i*GEMM_MR + j*GEMM_NR*ldc];
+      /* Next tile down the column, or the top of the next column. */
+      const FLOAT *C_next = (i != mp-1) ? Cij + GEMM_MR : &C[(j+1)*GEMM_NR*ldc];
+
+      /* Start of the next packed micro panel of A (or B, when we
+       * wrap around to the next column of tiles). */
+      if (i != mp-1)
+        __builtin_prefetch(&_A[(i+1)*kc*GEMM_MR]);
+      else
+        __builtin_prefetch(&_B[(j+1)*kc*GEMM_NR]);
+
+      /* Entirely above the diagonal */
+      if (lower && r0 + mr - 1 < c0)
+        continue;
+
+      if (mr == GEMM_MR && nr == GEMM_NR && !partial) {
+        /* Full tile, the micro kernel updates C directly. */
+        GEMM_FN(micro_kernel)(kc, &_A[i*kc*GEMM_MR], &_B[j*kc*GEMM_NR], Cij, ldc, C_next);
+      } else {
+        /* Fringe tile, multiply into a temporary, and copy out the
+         * part that exists in C (and is on or below the diagonal). */
+        FLOAT _C[GEMM_MR*GEMM_NR] __attribute__((aligned(64))) = {0};
+
+        GEMM_FN(micro_kernel)(kc, &_A[i*kc*GEMM_MR], &_B[j*kc*GEMM_NR], _C, GEMM_MR, C_next);
+
+        for (k = 0; k < nr; ++k) {
+          /* First row on or below the diagonal */
+          int l0 = partial && c0 + k > r0 ? c0 + k - r0 : 0;
+          for (l = l0; l < mr; ++l)
+            Cij[k*ldc + l] += _C[k*GEMM_MR + l];
+        }
+      }
+#ifndef GEMM_COMPLEX
+      if (ep)
+        GEMM_FN(tile_epilogue)(mr, nr, Cij, ldc, ep, r0, c0);
+#else
+      (void)ep;
+#endif
+    }
+  }
+}
+
+/*
+ * Multiply an mc x kc block of A into a kc x nc block of B, neither
+ * of which need be packed.
+ * A(i, l) is at A[i + l*lda], and micro panel i starts at A + i*sa.
+ * B(l, j) is at B[l*rsb + j*csb], and micro panel j starts at B + j*sb.
+ * Fringe tiles are done with plain loops, since for unpacked operands
+ * there is no zero padding to read.
+ */
+static inline __attribute__((always_inline))
+void GEMM_FN(macro_kernel_strided)(int mc, int nc, int kc,
+                                   const FLOAT * restrict A, int lda, int sa,
+                                   const FLOAT * restrict B, int rsb, int csb, int sb,
+                                   FLOAT * restrict C, int ldc)
+{
+  int i, j;
+  int mp = (mc+GEMM_MR-1) / GEMM_MR;
+  int np = (nc+GEMM_NR-1) / GEMM_NR;
+
+  int _mr = mc % GEMM_MR;
+  int _nr = nc % GEMM_NR;
+
+  for (j = 0; j < np; ++j) {
+    int nr = (j != np-1 || _nr == 0) ? GEMM_NR : _nr;
+
+    for (i = 0; i < mp; ++i) {
+      int mr = (i != mp-1 || _mr == 0) ? GEMM_MR : _mr;
+      const FLOAT *Ai = A + i*sa;
+      const FLOAT *Bj = B + j*sb;
+      FLOAT *Cij = &C[i*GEMM_MR + j*GEMM_NR*ldc];
+
+      if (mr == GEMM_MR && nr == GEMM_NR) {
+        GEMM_FN(micro_kernel_strided)(kc, Ai, lda, Bj, rsb, csb, Cij, ldc);
+      } else {
+        int ii, jj, l;
+        for (jj = 0; jj < nr; ++jj)
+          for (l = 0; l < kc; ++l)
+            for (ii = 0; ii < mr; ++ii)
+              Cij[ii + jj*ldc] += Ai[ii + l*lda] * Bj[l*rsb + jj*csb];
+      }
+    }
+  }
+}
+
+/*
+ * Small m x n: no packing at all, C stays in cache, and A and B are
+ * streamed through once.
+ */
+static void GEMM_FN(small_gemm)(int m, int n, int k,
+                                const FLOAT * restrict A, int lda,
+                                const FLOAT * restrict B, int ldb,
+                                FLOAT * restrict C, int ldc)
+{
+  GEMM_FN(macro_kernel_strided)(m, n, k, A, lda, GEMM_MR, B, 1, ldb, GEMM_NR*ldb, C, ldc);
+}
+
+/*
+ * Skinny k: the k x nc panel of B is small, pack it, and stream mc x k
+ * blocks of A through the micro kernel in place. A block is a few
+ * columns of contiguous rows, so it stays in L2 while we sweep along
+ * the panel of B.
+ */
+static void GEMM_FN(skinny_k_gemm)(int m, int n, int k,
+                                   const FLOAT * restrict A, int lda,
+                                   const FLOAT * restrict B, int ldb,
+                                   FLOAT * restrict C, int ldc,
+                                   int mcb, int ncb)
+{
+  FLOAT *_B;
+  uint64_t t;
+  int i, j;
+  int mb = (m+mcb-1) / mcb;
+  int nb = (n+ncb-1) / ncb;
+  int _mc = m % mcb;
+  int _nc = n % ncb;
+
+  _B = get_packing_buffer(sizeof(*_B)*k*((ncb / GEMM_NR)*GEMM_NR + (ncb % GEMM_NR ? GEMM_NR : 0)),
+                          "_B", &packed_B);
+  for (j = 0; j < nb; ++j) {
+    int nc = (j != nb-1 || _nc == 0) ? ncb : _nc;
+    t = now_ns();
+    GEMM_FN(pack_B)(k, nc, &B[j*ncb*ldb], ldb, _B);
+    __atomic_fetch_add(&pack_ns, now_ns() - t, __ATOMIC_RELAXED);
+    for (i = 0; i < mb; ++i) {
+      int mc = (i != mb-1 || _mc == 0) ? mcb : _mc;
+      GEMM_FN(macro_kernel_strided)(mc, nc, k, &A[i*mcb], lda, GEMM_MR,
+                                    _B, GEMM_NR, 1, k*GEMM_NR,
+                                    &C[i*mcb + j*ncb*ldc], ldc);
+    }
+  }
+}
+
+/*
+ * Skinny n: B is only a few columns, which stay in cache, so read it
+ * in place, and only pack blocks of A.
+ */
+static void GEMM_FN(skinny_n_gemm)(int m, int n, int k,
+                                   const FLOAT * restrict A, int lda,
+                                   const FLOAT * restrict B, int ldb,
+                                   FLOAT * restrict C, int ldc,
+                                   int mcb, int kcb)
+{
+  FLOAT *_A;
+  uint64_t t;
+  int i, l;
+  int mb = (m+mcb-1) / mcb;
+  int kb = (k+kcb-1) / kcb;
+  int _mc = m % mcb;
+  int _kc = k % kcb;
+
+  _A = get_packing_buffer(sizeof(*_A)*((mcb / GEMM_MR)*GEMM_MR + (mcb % GEMM_MR ? GEMM_MR : 0))*kcb,
+                          "_A", &packed_A);
+  for (l = 0; l < kb; ++l) {
+    int kc = (l != kb-1 || _kc == 0) ? kcb : _kc;
+    for (i = 0; i < mb; ++i) {
+      int mc = (i != mb-1 || _mc == 0) ? mcb : _mc;
+      t = now_ns();
+      GEMM_FN(pack_A)(mc, kc, &A[i*mcb + l*kcb*lda], lda, _A);
+      __atomic_fetch_add(&pack_ns, now_ns() - t, __ATOMIC_RELAXED);
+      GEMM_FN(macro_kernel_strided)(mc, n, kc, _A, GEMM_MR, kc*GEMM_MR,
+                                    &B[l*kcb], 1, ldb, GEMM_NR*ldb,
+                                    &C[i*mcb], ldc);
+    }
+  }
+}
+
+/*
+ * The body of GEMM_NAME and GEMM_EPILOGUE_NAME, ep is NULL for no
+ * epilogue.
+ */
+static void GEMM_FN(gemm)(int m, int n, int k,
+                          const FLOAT * restrict A, int lda,
+                          const FLOAT * restrict B, int ldb,
+                          FLOAT * restrict C, int ldc,
+                          const GEMM_EPILOGUE_T *ep)
+{
+  /*
+   * Local buffers for storing panels from A, and B.
+   */
+  FLOAT *_A = NULL;
+  FLOAT *_B = NULL;
+  uint64_t start, t;
+
+  int i, j, l;
+
+  /* Cache blocking, chosen at runtime */
+  const gemm_blocking_t *blocking = gemm_blocking(GEMM_MR, GEMM_NR, sizeof(FLOAT));
+  const int mcb = blocking->mc;
+  const int kcb = blocking->kc;
+  const int ncb = blocking->nc;
+
+  /* Number of full blocks */
+  int mb = (m+mcb-1) / mcb;
+  int nb = (n+ncb-1) / ncb;
+  int kb = (k+kcb-1) / kcb;
+
+  /* Clean up tiles */
+  int _mc = m % mcb;
+  int _nc = n % ncb;
+  int _kc = k % kcb;
+  LIKWID_MARKER_START(GEMM_MARKER);
+  start = now_ns();
+
+  if (shape_dispatch) {
+    int done = 1;
+    /* The skinny paths have no epilogue hook, but a small C is still
+     * in cache after small_gemm, so a second pass over it is cheap. */
+    if ((long)m*n <= SMALL_MN_MAX) {
+      GEMM_FN(small_gemm)(m, n, k, A, lda, B, ldb, C, ldc);
+#ifndef GEMM_COMPLEX
+      if (ep)
+        GEMM_FN(tile_epilogue)(m, n, C, ldc, ep, 0, 0);
+#endif
+    } else if (ep)
+      done = 0;
+    else if (k <= SKINNY_K_MAX)
+      GEMM_FN(skinny_k_gemm)(m, n, k, A, lda, B, ldb, C, ldc, mcb, ncb);
+    else if (n <= SKINNY_N_MAX)
+      GEMM_FN(skinny_n_gemm)(m, n, k, A, lda, B, ldb, C, ldc, mcb, kcb);
+    else
+      done = 0;
+    if (done) {
+      __atomic_fetch_add(&total_ns, now_ns() - start, __ATOMIC_RELAXED);
+      LIKWID_MARKER_STOP(GEMM_MARKER);
+      return;
+    }
+  }
+
+  _A = get_packing_buffer(sizeof(*_A)*((mcb / GEMM_MR)*GEMM_MR + (mcb % GEMM_MR ? GEMM_MR : 0))*kcb,
+                          "_A", &packed_A);
+  _B = get_packing_buffer(sizeof(*_B)*kcb*((ncb / GEMM_NR)*GEMM_NR + (ncb % GEMM_NR ? GEMM_NR : 0)),
+                          "_B", &packed_B);
+
+  for (j = 0; j < nb; ++j) {
+    /* Only the last iteration might not be a full tile */
+    int nc = (j != nb-1 || _nc == 0) ? ncb : _nc;
+
+    for (l = 0; l < kb; ++l) {
+      /* Only the last iteration might not be a full tile */
+      int kc = (l != kb-1 || _kc == 0) ? kcb : _kc;
+
+      /* Pack kc x nc long thin row of B */
+      t = now_ns();
+      GEMM_FN(pack_B)(kc, nc, &B[l*kcb + j*ncb*ldb], ldb, _B);
+      __atomic_fetch_add(&pack_ns, now_ns() - t, __ATOMIC_RELAXED);
+
+      for (i = 0; i < mb; ++i) {
+        /* Only the last iteration might not be a full tile */
+        int mc = (i != mb-1 || _mc == 0) ? mcb : _mc;
+
+        /* Pack mc x kc tall thin column of A */
+        t = now_ns();
+        GEMM_FN(pack_A)(mc, kc, &A[i*mcb + l*kcb*lda], lda, _A);
+        __atomic_fetch_add(&pack_ns, now_ns() - t, __ATOMIC_RELAXED);
+
+        /* The epilogue goes with the last contribution to C */
+        GEMM_FN(macro_kernel)(mc, nc, kc, _A, _B, &C[i*mcb + j*ncb*ldc], ldc,
+                              l == kb-1 ? ep : NULL, i*mcb, j*ncb, 0);
+      }
+    }
+  }
+#ifndef GEMM_COMPLEX
+  /* No products at all, but the epilogue still applies */
+  if (ep && kb == 0)
+    GEMM_FN(tile_epilogue)(m, n, C, ldc, ep, 0, 0);
+#endif
+  __atomic_fetch_add(&total_ns, now_ns() - start, __ATOMIC_RELAXED);
+  LIKWID_MARKER_STOP(GEMM_MARKER);
+}
+
+void GEMM_NAME(int m, int n, int k,
+               const FLOAT * restrict A, int lda,
+               const FLOAT * restrict B, int ldb,
+               FLOAT * restrict C, int ldc)
+{
+  GEMM_FN(gemm)(m, n, k, A, lda, B, ldb, C, ldc, NULL);
+}
+
+#ifndef GEMM_COMPLEX
+/*
+ * Compute C = C + A*B, and apply the epilogue ep (see epilogue.h) to
+ * each tile of C as it is written back.
+ */
+void GEMM_EPILOGUE_NAME(int m, int n, int k,
+                        const FLOAT * restrict A, int lda,
+                        const FLOAT * restrict B, int ldb,
+                        FLOAT * restrict C, int ldc,
+                        const GEMM_EPILOGUE_T *ep)
+{
+  GEMM_FN(gemm)(m, n, k, A, lda, B, ldb, C, ldc, ep);
+}
+#endif
+
+#ifdef GEMM_NT_NAME
+/*
+ * C = C + alpha*A*B^T, with C m x n, A m x k, and B n x k. If lower
+ * is set (and m = n), only the lower triangle of C is updated, and
+ * only the tiles touching it are computed, which halves the flops
+ * for a SYRK.
+ */
+static void GEMM_FN(gemm_nt)(int m, int n, int k,
+                             const FLOAT * restrict A, int lda,
+                             const FLOAT * restrict B, int ldb,
+                             FLOAT * restrict C, int ldc,
+                             FLOAT alpha, int lower)
+{
+  FLOAT *_A, *_B;
+  int i, j, l;
+  const gemm_blocking_t *blocking = gemm_blocking(GEMM_MR, GEMM_NR, sizeof(FLOAT));
+  const int mcb = blocking->mc;
+  const int kcb = blocking->kc;
+  const int ncb = blocking->nc;
+  int mb = (m+mcb-1) / mcb;
+  int nb = (n+ncb-1) / ncb;
+  int kb = (k+kcb-1) / kcb;
+  int _mc = m % mcb;
+  int _nc = n % ncb;
+  int _kc = k % kcb;
+
+  _A = get_packing_buffer(sizeof(*_A)*((mcb / GEMM_MR)*GEMM_MR + (mcb % GEMM_MR ? GEMM_MR : 0))*kcb,
+                          "_A", &packed_A);
+  _B = get_packing_buffer(sizeof(*_B)*kcb*((ncb / GEMM_NR)*GEMM_NR + (ncb % GEMM_NR ? GEMM_NR : 0)),
+                          "_B", &packed_B);
+
+  for (j = 0; j < nb; ++j) {
+    int nc = (j != nb-1 || _nc == 0) ? ncb : _nc;
+    for (l = 0; l < kb; ++l) {
+      int kc = (l != kb-1 || _kc == 0) ? kcb : _kc;
+      GEMM_FN(pack_Bt)(kc, nc, &B[j*ncb + l*kcb*ldb], ldb, _B, alpha);
+      for (i = 0; i < mb; ++i) {
+        int mc = (i != mb-1 || _mc == 0) ? mcb : _mc;
+        /* Block entirely above the diagonal */
+        if (lower && i*mcb + mc - 1 < j*ncb)
+          continue;
+        GEMM_FN(pack_A)(mc, kc, &A[i*mcb + l*kcb*lda], lda, _A);
+        GEMM_FN(macro_kernel)(mc, nc, kc, _A, _B, &C[i*mcb + j*ncb*ldc], ldc,
+                              NULL, i*mcb, j*ncb, lower);
+      }
+    }
+  }
+}
+
+void GEMM_NT_NAME(int m, int n, int k,
+                  const FLOAT * restrict A, int lda,
+                  const FLOAT * restrict B, int ldb,
+                  FLOAT * restrict C, int ldc,
+                  FLOAT alpha)
+{
+  GEMM_FN(gemm_nt)(m, n, k, A, lda, B, ldb, C, ldc, alpha, 0);
+}
+
+/*
+ * C = C + alpha*A*A^T, only the lower triangle of the n x n matrix C
+ * is referenced. A is n x k.
+ */
+void GEMM_SYRK_NAME(int n, int k,
+                    const FLOAT * restrict A, int lda,
+                    FLOAT * restrict C, int ldc,
+                    FLOAT alpha)
+{
+  GEMM_FN(gemm_nt)(n, n, k, A, lda, A, lda, C, ldc, alpha, 1);
+}
+#endif
@@ -5,55 +5,97 @@
 #include <float.h>
 #include <time.h>
 #include <errno.h>
+#include <complex.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 
 #include "likwidinc.h"
+#include "epilogue.h"
+#include "../../common/bench.h"
 
-typedef void (*gemm_fn_t)(int, int, int,
-                          const double *, int,
-                          const double *, int,
-                          double *, int);
+#ifdef HAVE_OPENBLAS
+#include <cblas.h>
+#endif
 
 void optimised_gemm(int, int, int,
                     const double *, int,
                     const double *, int,
                     double *, int);
 
-static void basic_gemm(int, int, int,
-                       const double *, int,
-                       const double *, int,
-                       double *, int);
-/* Compute C = C + A*B
- *
- * C has rank m x n (m rows, n columns)
- * A has rank m x k
- * B has rank k x n
- * ldX is the leading dimension of the respective matrix.
- *
- * All matrices are stored in column major format.
- * That is, for row index i, column index j, and leading dimension ldX,
- * the correct entry is at (ldX*i + j).
+void optimised_gemm_epilogue(int, int, int,
+                             const double *, int,
+                             const double *, int,
+                             double *, int,
+                             const gemm_epilogue_t *);
+
+void optimised_sgemm(int, int, int,
+                     const float *, int,
+                     const float *, int,
+                     float *, int);
+
+void optimised_zgemm(int, int, int,
+                     const double complex *, int,
+                     const double complex *, int,
+                     double complex *, int);
+
+void strassen_gemm(int, int, int,
+                   const double *, int,
+                   const double *, int,
+                   double *, int);
+
+void strassen_gemm_ws(int, int, int,
+                      const double *, int,
+                      const double *, int,
+                      double *, int,
+                      double *);
+
+size_t strassen_workspace_size(int, int, int);
+
+double strassen_error_factor(int, int, int);
+
+void optimised_gemm_set_shape_dispatch(int);
+void optimised_gemm_timers(double *, double *);
+void optimised_gemm_reset_timers(void);
+
+int cholesky(int, double *, int, int);
+
+int ooc_gemm(int, int, int, const char *, const char *, const char *, size_t);
+
+void batched_gemm_strided(int, int, int,
+                          const double *, int, long,
+                          const double *, int, long,
+                          double *, int, long,
+                          int);
+
+/*
+ * Print entries of a matrix.
+ * if num_entries is < 0, print all entries, otherwise just print the
+ * top num_entries x num_entries corner.
  */
-static void basic_gemm(int m, int n, int k,
-                       const double *a, int lda,
-                       const double *b, int ldb,
-                       double *c, int ldc)
+__attribute__((unused))
+static void print_matrix(int m, int n, const double *a, int lda,
+                         int num_entries)
 {
-  int i, j, p;
-  LIKWID_MARKER_START("BASIC_GEMM");
-  for (j = 0; j < n; j++) {
-    for (p = 0; p < k; p++) {
-      for (i = 0; i < m; i++) {
-        c[j*ldc + i] = c[j*ldc + i] + a[p*lda + i] * b[j*ldb + p];
-      }
+  int i, j;
+  if (num_entries >= 0) {
+    n = n < num_entries ? n : num_entries;
+    m = m < num_entries ? m : num_entries;
+  }
+
+  for (i = 0; i < m; i++) {
+    for (j = 0; j < n; j++) {
+      printf("%.5g ", a[j*lda + i]);
     }
+    printf("\n");
   }
-  LIKWID_MARKER_STOP("BASIC_GEMM");
 }
 
-void alloc_matrix(int m, int n, double **a)
+static void *alloc_aligned(size_t bytes)
 {
+  void *a = NULL;
   int err;
-  err = posix_memalign((void **)a, 64, m*n*sizeof(**a));
+  err = posix_memalign(&a, 64, bytes);
   if (err) {
     fprintf(stderr, "posix_memalign failed: ");
     switch (err) {
@@ -68,182 +110,795 @@ void alloc_matrix(int m, int n, double **a)
     }
     exit(1);
   }
+  return a;
 }
 
-void free_matrix(double **a)
+/*
+ * Above this many multiply-adds we don't compare against basic_gemm,
+ * since that is O(mnk), but use the randomised check below.
+ */
+#define EXACT_CHECK_LIMIT 1e8
+
+/* Number of random vectors for the randomised check */
+#define CHECK_NVEC 3
+
+/* gamma_n = n u / (1 - n u), the usual rounding error constant, for
+ * unit roundoff u = eps/2 */
+static double gamma_n(int n, double eps)
 {
-  free(*a);
-  *a = NULL;
+  const double u = eps / 2;
+  return n*u / (1 - n*u);
 }
 
 /*
- * Print entries of a matrix.
- * if num_entries is < 0, print all entries, otherwise just print the
- * top num_entries x num_entries corner.
+ * Instantiate check() and bench() for each element type. The double
+ * versions keep the plain names. Complex products are accumulated
+ * with a complex multiply-add (4 multiplications and 4 additions),
+ * which has the error of an inner product two terms longer
+ * (Higham, Accuracy and Stability of Numerical Algorithms, sec. 3.6).
  */
-__attribute__((unused))
-static void print_matrix(int m, int n, const double *a, int lda,
-                         int num_entries)
+#define FLOAT double
+#define REAL double
+#define FN(f) f
+#define EPSILON DBL_EPSILON
+#define ABS(x) fabs(x)
+#define RANDOM() drand48()
+#define RANDOM_SIGNED() (2*drand48() - 1)
+#define FLOP_PER_FMA 2
+#define GAMMA_EXTRA 0
+#define MAX_PRODUCT 1
+#include "check-bench.c"
+#undef FLOAT
+#undef REAL
+#undef FN
+#undef EPSILON
+#undef ABS
+#undef RANDOM
+#undef RANDOM_SIGNED
+#undef FLOP_PER_FMA
+#undef GAMMA_EXTRA
+#undef MAX_PRODUCT
+
+#define FLOAT float
+#define REAL float
+#define FN(f) s_##f
+#define EPSILON FLT_EPSILON
+#define ABS(x) fabsf(x)
+#define RANDOM() ((float)drand48())
+#define RANDOM_SIGNED() ((float)(2*drand48() - 1))
+#define FLOP_PER_FMA 2
+#define GAMMA_EXTRA 0
+#define MAX_PRODUCT 1
+#include "check-bench.c"
+#undef FLOAT
+#undef REAL
+#undef FN
+#undef EPSILON
+#undef ABS
+#undef RANDOM
+#undef RANDOM_SIGNED
+#undef FLOP_PER_FMA
+#undef GAMMA_EXTRA
+#undef MAX_PRODUCT
+
+#define FLOAT double complex
+#define REAL double
+#define FN(f) z_##f
+#define EPSILON DBL_EPSILON
+#define ABS(x) cabs(x)
+#define RANDOM() (drand48() + I*drand48())
+#define RANDOM_SIGNED() ((2*drand48() - 1) + I*(2*drand48() - 1))
+#define FLOP_PER_FMA 8
+#define GAMMA_EXTRA 2
+#define MAX_PRODUCT 2
+#include "check-bench.c"
+#undef FLOAT
+#undef REAL
+#undef FN
+#undef EPSILON
+#undef ABS
+#undef RANDOM
+#undef RANDOM_SIGNED
+#undef FLOP_PER_FMA
+#undef GAMMA_EXTRA
+#undef MAX_PRODUCT
+
+/*
+ * A batch of one, with the gemm_fn_t signature, so that the small
+ * matrix kernels can be verified by check().
+ */
+static void single_batched_gemm(int m, int n, int k,
+                                const double *a, int lda,
+                                const double *b, int ldb,
+                                double *c, int ldc)
 {
-  int i, j;
-  if (num_entries >= 0) {
-    n = n < num_entries ? n : num_entries;
-    m = m < num_entries ? m : num_entries;
-  }
+  batched_gemm_strided(m, n, k, a, lda, 0, b, ldb, 0, c, ldc, 0, 1);
+}
 
-  for (i = 0; i < m; i++) {
-    for (j = 0; j < n; j++) {
-      printf("%.5g ", a[j*lda + i]);
-    }
-    printf("\n");
-  }
+
+#ifdef HAVE_OPENBLAS
+/* cblas_dgemm with the gemm_fn_t signature, computing C = C + A*B */
+static void openblas_gemm(int m, int n, int k,
+                          const double *a, int lda,
+                          const double *b, int ldb,
+                          double *c, int ldc)
+{
+  cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans,
+              m, n, k, 1.0, a, lda, b, ldb, 1.0, c, ldc);
 }
+#endif
+
+typedef struct GemmCall {
+  gemm_fn_t gemm;
+  int m, n, k;
+  const double *a, *b;
+  double *c;
+  int lda, ldb, ldc;
+} GemmCall;
 
-static void zero_matrix(int m, int n, double *a, int lda)
+static double gemm_time(void *ctx, size_t reps)
 {
-  int i, j;
-  for (j = 0; j < n; j++) {
-    for (i = 0; i < m; i++) {
-      a[j*lda + i] = 0.0;
+  GemmCall *g = ctx;
+  double start = bench_timestamp();
+  size_t r;
+  for (r = 0; r < reps; r++)
+    g->gemm(g->m, g->n, g->k, g->a, g->lda, g->b, g->ldb, g->c, g->ldc);
+  return bench_timestamp() - start;
+}
+
+/*
+ * Median wall clock time for one call of gemm, which is reported as
+ * variant of mode (see ../../common/bench.h).
+ */
+static double time_gemm(const char *mode, const char *variant,
+                        int m, int n, int k, gemm_fn_t gemm,
+                        const double *a, int lda,
+                        const double *b, int ldb,
+                        double *c, int ldc)
+{
+  GemmCall args = {gemm, m, n, k, a, b, c, lda, ldb, ldc};
+  BenchResult result;
+  char name[64], params[96];
+
+  bench_run(gemm_time, &args, &result);
+  snprintf(name, sizeof(name), "gemm/%s", mode);
+  snprintf(params, sizeof(params), "variant=%s m=%d n=%d k=%d", variant, m, n, k);
+  bench_report(name, params, &result, 2.0*(double)m*(double)n*(double)k, "FLOP");
+  return result.median;
+}
+
+/*
+ * Compare optimised_gemm against cblas_dgemm from OpenBLAS on the
+ * same inputs.
+ * m, n, k: matrix sizes C[m, n] = C[m, n] + A[m, k]*B[k, n]
+ * prints, in the layout of figures/gemm-openblas.dat (N is M, this is
+ * intended for square sweeps):
+ *  N TIME FLOP REFTIME GFLOP/s REFGFLOP/s PERCENT
+ * where PERCENT is the percentage of OpenBLAS performance achieved.
+ * Times are wall clock, since OpenBLAS may use threads (set
+ * OPENBLAS_NUM_THREADS=1 for a single core comparison).
+ */
+static int bench_reference(int m, int n, int k)
+{
+#ifdef HAVE_OPENBLAS
+  double *a = NULL;
+  double *b = NULL;
+  double *c = NULL;
+  double time, reftime, flop;
+  int lda, ldb, ldc;
+
+  alloc_matrix(m, k, &a);
+  alloc_matrix(k, n, &b);
+  alloc_matrix(m, n, &c);
+
+  lda = m;
+  ldb = k;
+  ldc = m;
+
+  random_matrix(m, k, a, lda);
+  random_matrix(k, n, b, ldb);
+  zero_matrix(m, n, c, ldc);
+
+  flop = 2.0*(double)m*(double)n*(double)k;
+  time = time_gemm("REFERENCE", "optimised", m, n, k, &optimised_gemm, a, lda, b, ldb, c, ldc);
+  reftime = time_gemm("REFERENCE", "openblas", m, n, k, &openblas_gemm, a, lda, b, ldb, c, ldc);
+  printf("%d %g %g %g %g %g %.1f\n", m, time, flop, reftime,
+         1e-9*flop/time, 1e-9*flop/reftime, 100*reftime/time);
+  free_matrix(&a);
+  free_matrix(&b);
+  free_matrix(&c);
+  return 0;
+#else
+  (void)m; (void)n; (void)k;
+  fprintf(stderr, "REFERENCE mode needs OpenBLAS, rebuild with USE_OPENBLAS=Yes\n");
+  return 1;
+#endif
+}
+
+/*
+ * Benchmark optimised_gemm on skinny shapes, with and without the
+ * shape specific code paths.
+ * m, n, k: the large dimensions.
+ * For s in 8, 16, 32, 64, runs the shapes
+ *   m x s x k (skinny n), m x n x s (skinny k), s x s x k (small m x n)
+ * prints, for each:
+ *  m n k TIME FLOP/s GENERALTIME GENERALFLOP/s
+ * where the GENERAL columns use the blocked algorithm for everything.
+ */
+static void bench_shapes(int m, int n, int k)
+{
+  static const int skinny[] = {8, 16, 32, 64};
+  int i, shape;
+
+  for (i = 0; i < (int)(sizeof(skinny)/sizeof(skinny[0])); i++) {
+    const int s = skinny[i];
+    for (shape = 0; shape < 3; shape++) {
+      int m_ = shape == 2 ? s : m;
+      int n_ = shape == 0 || shape == 2 ? s : n;
+      int k_ = shape == 1 ? s : k;
+      double *a = NULL;
+      double *b = NULL;
+      double *c = NULL;
+      double time, gentime, flop;
+
+      alloc_matrix(m_, k_, &a);
+      alloc_matrix(k_, n_, &b);
+      alloc_matrix(m_, n_, &c);
+      random_matrix(m_, k_, a, m_);
+      random_matrix(k_, n_, b, k_);
+      zero_matrix(m_, n_, c, m_);
+      flop = 2.0*(double)m_*(double)n_*(double)k_;
+
+      optimised_gemm_set_shape_dispatch(1);
+      time = time_gemm("SHAPES", "dispatch", m_, n_, k_, &optimised_gemm, a, m_, b, k_, c, m_);
+      optimised_gemm_set_shape_dispatch(0);
+      gentime = time_gemm("SHAPES", "general", m_, n_, k_, &optimised_gemm, a, m_, b, k_, c, m_);
+      optimised_gemm_set_shape_dispatch(1);
+
+      printf("%d %d %d %g %g %g %g\n", m_, n_, k_,
+             time, flop/time, gentime, flop/gentime);
+      free_matrix(&a);
+      free_matrix(&b);
+      free_matrix(&c);
     }
-  }    
+  }
 }
 
-static void random_matrix(int m, int n, double *a, int lda)
+/*
+ * The epilogue as a separate pass over C, which is what the fused
+ * version saves.
+ */
+static void apply_epilogue(int m, int n, double *c, int ldc,
+                           const gemm_epilogue_t *ep)
 {
   int i, j;
   for (j = 0; j < n; j++) {
     for (i = 0; i < m; i++) {
-      a[j*lda + i] = drand48();
+      double x = ep->alpha*c[j*ldc + i];
+      if (ep->row_bias)
+        x += ep->row_bias[i];
+      if (ep->col_bias)
+        x += ep->col_bias[j];
+      c[j*ldc + i] = fmin(fmax(x, ep->lo), ep->hi);
     }
   }
 }
 
-static double diff_time(struct timespec end, struct timespec start)
+/* The epilogue used by the gemm_fn_t wrappers below */
+static const gemm_epilogue_t *current_epilogue = NULL;
+
+static void fused_epilogue_gemm(int m, int n, int k,
+                                const double *a, int lda,
+                                const double *b, int ldb,
+                                double *c, int ldc)
+{
+  optimised_gemm_epilogue(m, n, k, a, lda, b, ldb, c, ldc, current_epilogue);
+}
+
+static void separate_epilogue_gemm(int m, int n, int k,
+                                   const double *a, int lda,
+                                   const double *b, int ldb,
+                                   double *c, int ldc)
 {
-  double secs = (double)end.tv_sec - (double)start.tv_sec;
-  double nsecs = (double)end.tv_nsec - (double)start.tv_nsec;
-  return secs + 1e-9*nsecs;
+  optimised_gemm(m, n, k, a, lda, b, ldb, c, ldc);
+  apply_epilogue(m, n, c, ldc, current_epilogue);
 }
 
 /*
- * Check that a matrix matches the result of multiplication with
- * "basic" implementation.
- * m, n, k: size of matrices to check.
- * C has rank m x n (m rows, n columns)
- * A has rank m x k
- * B has rank k x n
- * gemm: function pointer to gemm implementation.
+ * Set up an epilogue with random biases, scaling, and a clamp that
+ * catches entries at both ends for random inputs.
+ */
+static void random_epilogue(int m, int n, int k, gemm_epilogue_t *ep,
+                            double **row_bias, double **col_bias)
+{
+  alloc_matrix(m, 1, row_bias);
+  alloc_matrix(n, 1, col_bias);
+  random_matrix(m, 1, *row_bias, m);
+  random_matrix(n, 1, *col_bias, n);
+  ep->alpha = 0.5;
+  ep->row_bias = *row_bias;
+  ep->col_bias = *col_bias;
+  /* alpha*(A*B) is around k/8 */
+  ep->lo = k/8.0;
+  ep->hi = k/8.0 + 1;
+}
+
+/*
+ * Check optimised_gemm_epilogue against optimised_gemm followed by a
+ * separate pass over C, on the same inputs (including a nonzero C).
  * Returns 1 if the check failed, 0 if it passed.
  */
-static int check(int m, int n, int k, gemm_fn_t gemm, double *maxdiff)
+static int check_epilogue(int m, int n, int k, double *maxdiff)
 {
   double *a = NULL;
   double *b = NULL;
-  double *copt = NULL;
-  double *cbasic = NULL;
-  *maxdiff = -1;
+  double *cfused = NULL;
+  double *cseparate = NULL;
+  double *row_bias = NULL;
+  double *col_bias = NULL;
+  gemm_epilogue_t ep;
+  /* The two may block the sum differently, see check() */
+  const double tol = 2*gamma_n(k + 1, DBL_EPSILON)*(k + 1);
   int i, j;
-  int lda, ldb, ldc;
 
   alloc_matrix(m, k, &a);
   alloc_matrix(k, n, &b);
-  alloc_matrix(m, n, &copt);
-  alloc_matrix(m, n, &cbasic);
-
-  lda = m;
-  ldb = k;
-  ldc = m;
-
-  random_matrix(m, k, a, lda);
-  random_matrix(k, n, b, ldb);
-  zero_matrix(m, n, copt, ldc);
-  zero_matrix(m, n, cbasic, ldc);
+  alloc_matrix(m, n, &cfused);
+  alloc_matrix(m, n, &cseparate);
+  random_matrix(m, k, a, m);
+  random_matrix(k, n, b, k);
+  random_matrix(m, n, cfused, m);
+  memcpy(cseparate, cfused, (size_t)m*n*sizeof(*cfused));
+  random_epilogue(m, n, k, &ep, &row_bias, &col_bias);
 
-  basic_gemm(m, n, k, a, lda, b, ldb, cbasic, ldc);
-  gemm(m, n, k, a, lda, b, ldb, copt, ldc);
+  optimised_gemm_epilogue(m, n, k, a, m, b, k, cfused, m, &ep);
+  optimised_gemm(m, n, k, a, m, b, k, cseparate, m);
+  apply_epilogue(m, n, cseparate, m, &ep);
 
+  *maxdiff = 0;
   for (j = 0; j < n; j++) {
     for (i = 0; i < m; i++) {
-      double diff = fabs(copt[j*ldc + i] - cbasic[j*ldc + i]);
-      if (diff != diff) {
-        *maxdiff = diff;
-        goto done;
-      } else {
-        *maxdiff = fmax(*maxdiff, diff);
-      }
+      double diff = fabs(cfused[j*m + i] - cseparate[j*m + i]);
+      *maxdiff = diff != diff ? diff : fmax(*maxdiff, diff);
     }
   }
- done:
+
   free_matrix(&a);
   free_matrix(&b);
-  free_matrix(&copt);
-  free_matrix(&cbasic);
-  return (*maxdiff > 1e-3) || (*maxdiff != *maxdiff);
+  free_matrix(&cfused);
+  free_matrix(&cseparate);
+  free_matrix(&row_bias);
+  free_matrix(&col_bias);
+  return !(*maxdiff <= tol);
 }
 
 /*
- * Benchmark the provided gemm implementation.
+ * Benchmark optimised_gemm_epilogue against optimised_gemm followed by
+ * a separate pass over C.
  * m, n, k: matrix sizes C[m, n] = C[m, n] + A[m, k]*B[k, n]
- * gemm: Function pointer to gemm implementation
  * prints:
- *  m n k TIME FLOP FLOP/s
+ *  m n k TIME FLOP/s SEPARATETIME SEPARATEFLOP/s
+ * where FLOP/s only counts the 2mnk flops of the gemm.
  */
-static void bench(int m, int n, int k, gemm_fn_t gemm)
+static void bench_epilogue(int m, int n, int k)
 {
   double *a = NULL;
   double *b = NULL;
   double *c = NULL;
-  struct timespec start, end;
-  double time, flop;
-  int repeats, i;
-  int lda, ldb, ldc;
+  double *row_bias = NULL;
+  double *col_bias = NULL;
+  gemm_epilogue_t ep;
+  double time, septime, flop;
 
   alloc_matrix(m, k, &a);
   alloc_matrix(k, n, &b);
   alloc_matrix(m, n, &c);
+  random_matrix(m, k, a, m);
+  random_matrix(k, n, b, k);
+  zero_matrix(m, n, c, m);
+  random_epilogue(m, n, k, &ep, &row_bias, &col_bias);
+  current_epilogue = &ep;
 
-  lda = m;
-  ldb = k;
-  ldc = m;
+  flop = 2.0*(double)m*(double)n*(double)k;
+  time = time_gemm("EPILOGUE", "fused", m, n, k, &fused_epilogue_gemm, a, m, b, k, c, m);
+  septime = time_gemm("EPILOGUE", "separate", m, n, k, &separate_epilogue_gemm, a, m, b, k, c, m);
+  printf("%d %d %d %g %g %g %g\n", m, n, k, time, flop/time,
+         septime, flop/septime);
 
-  random_matrix(m, k, a, lda);
-  random_matrix(k, n, b, ldb);
-  zero_matrix(m, n, c, ldc);
+  current_epilogue = NULL;
+  free_matrix(&a);
+  free_matrix(&b);
+  free_matrix(&c);
+  free_matrix(&row_bias);
+  free_matrix(&col_bias);
+}
+
+/*
+ * A random symmetric positive definite n x n matrix: off diagonal
+ * entries in [0, 1), and a diagonal large enough to make it strictly
+ * diagonally dominant.
+ */
+static void spd_matrix(int n, double *a, int lda)
+{
+  int i, j;
+  for (j = 0; j < n; j++) {
+    for (i = j + 1; i < n; i++) {
+      a[j*lda + i] = drand48();
+      a[i*lda + j] = a[j*lda + i];
+    }
+    a[j*lda + j] = n + drand48();
+  }
+}
+
+/*
+ * Check the tiled Cholesky factorisation with tiles of size nb.
+ * The residual satisfies (Higham, Accuracy and Stability of Numerical
+ * Algorithms, thm. 10.3)
+ *
+ *   ||A - L L^T||_F <= gamma_{n+1} || |L| |L^T| ||_F <= gamma_{n+1} ||L||_F^2
+ *
+ * whatever order the inner products are summed in. residual is set to
+ * ||A - L L^T||_F / ||A||_F.
+ * Returns 1 if the check failed, 0 if it passed.
+ */
+static int check_cholesky(int n, int nb, double *residual)
+{
+  double *a = NULL;
+  double *l = NULL;
+  double rnorm = 0, anorm = 0, lnorm = 0;
+  int info;
+  int i, j, p;
+
+  alloc_matrix(n, n, &a);
+  alloc_matrix(n, n, &l);
+  spd_matrix(n, a, n);
+  memcpy(l, a, (size_t)n*n*sizeof(*a));
+
+  info = cholesky(n, l, n, nb);
+  if (info) {
+    fprintf(stderr, "cholesky failed at leading minor %d\n", info);
+    free_matrix(&a);
+    free_matrix(&l);
+    *residual = NAN;
+    return 1;
+  }
+
+  /* Both triangles of the residual, from the lower one */
+  for (j = 0; j < n; j++) {
+    for (i = j; i < n; i++) {
+      double r = a[j*n + i];
+      const double w = i == j ? 1 : 2;
+      for (p = 0; p <= j; p++)
+        r -= l[p*n + i] * l[p*n + j];
+      rnorm += w*r*r;
+      anorm += w*a[j*n + i]*a[j*n + i];
+      lnorm += l[j*n + i]*l[j*n + i];
+    }
+  }
+  rnorm = sqrt(rnorm);
+  anorm = sqrt(anorm);
+
+  *residual = rnorm / anorm;
+  free_matrix(&a);
+  free_matrix(&l);
+  return !(rnorm <= gamma_n(n + 1, DBL_EPSILON)*lnorm);
+}
+
+typedef struct CholeskyArgs {
+  int n, nb;
+  const double *a;
+  double *l;
+} CholeskyArgs;
+
+/* Each factorisation starts from a fresh copy of A, which isn't timed */
+static double cholesky_time(void *ctx, size_t reps)
+{
+  CholeskyArgs *ch = ctx;
+  double time = 0, start;
+  size_t r;
+  for (r = 0; r < reps; r++) {
+    memcpy(ch->l, ch->a, (size_t)ch->n*ch->n*sizeof(*ch->a));
+    start = bench_timestamp();
+    if (cholesky(ch->n, ch->l, ch->n, ch->nb)) {
+      fprintf(stderr, "cholesky failed\n");
+      exit(1);
+    }
+    time += bench_timestamp() - start;
+  }
+  return time;
+}
+
+/*
+ * Benchmark the tiled Cholesky factorisation with tiles of size nb.
+ * prints:
+ *  n nb TIME FLOP FLOP/s
+ * where FLOP is n^3/3, and TIME the median. Times are wall clock,
+ * since the factorisation runs on all OpenMP threads.
+ */
+static void bench_cholesky(int n, int nb)
+{
+  double *a = NULL;
+  double *l = NULL;
+  double flop;
+  CholeskyArgs args;
+  BenchResult result;
+  char params[64];
+
+  alloc_matrix(n, n, &a);
+  alloc_matrix(n, n, &l);
+  spd_matrix(n, a, n);
+  flop = (double)n*n*n / 3;
+
+  args.n = n;
+  args.nb = nb;
+  args.a = a;
+  args.l = l;
+  bench_run(cholesky_time, &args, &result);
+  printf("%d %d %g %g %g\n", n, nb, result.median, flop, flop/result.median);
+  snprintf(params, sizeof(params), "n=%d nb=%d", n, nb);
+  bench_report("gemm/CHOLESKY", params, &result, flop, "FLOP");
+  free_matrix(&a);
+  free_matrix(&l);
+}
+
+/*
+ * Write an m x n matrix to a file, a column at a time, with random
+ * entries (or zeros). Then push it out of the page cache, so that
+ * ooc_gemm really reads it from disk.
+ */
+static int write_matrix_file(const char *path, int m, int n, int random)
+{
+  double *col = NULL;
+  FILE *f;
+  int i, j;
+
+  f = fopen(path, "wb");
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  alloc_matrix(m, 1, &col);
+  for (j = 0; j < n; j++) {
+    for (i = 0; i < m; i++)
+      col[i] = random ? drand48() : 0.0;
+    if (fwrite(col, sizeof(*col), m, f) != (size_t)m) {
+      perror(path);
+      fclose(f);
+      free_matrix(&col);
+      return 1;
+    }
+  }
+  free_matrix(&col);
+  fflush(f);
+  fsync(fileno(f));
+  (void)posix_fadvise(fileno(f), 0, 0, POSIX_FADV_DONTNEED);
+  fclose(f);
+  return 0;
+}
+
+static const double *map_matrix_file(const char *path, size_t bytes)
+{
+  void *p;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return NULL;
+  }
+  p = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+/*
+ * Run ooc_gemm on matrices in files, which are created in OOC_DIR
+ * (default: the current directory) and removed afterwards. The memory
+ * budget is OOC_BUDGET_MB megabytes (default 64).
+ * If check is set, verify the result with the randomised check,
+ * otherwise compare the speed with optimised_gemm on the same problem
+ * in memory, and print
+ *  m n k TIME FLOP/s INMEMTIME INMEMFLOP/s
+ * The in-memory columns are 0 if OOC_NO_INMEM is set (for problems
+ * that don't fit). The out of core time is for a single run, since
+ * each needs the files out of the page cache, the in-memory time is
+ * the median.
+ * Returns 0 on success, 1 on failure.
+ */
+static int run_ooc(int m, int n, int k, int check)
+{
+  const char *dir = getenv("OOC_DIR") ? getenv("OOC_DIR") : ".";
+  size_t budget = (getenv("OOC_BUDGET_MB") ? atol(getenv("OOC_BUDGET_MB")) : 64)*1024*1024UL;
+  char a_path[4096], b_path[4096], c_path[4096];
+  double start, time, memtime = 0, flop;
+  int status = 0;
+
+  snprintf(a_path, sizeof(a_path), "%s/ooc-A-%d.dat", dir, (int)getpid());
+  snprintf(b_path, sizeof(b_path), "%s/ooc-B-%d.dat", dir, (int)getpid());
+  snprintf(c_path, sizeof(c_path), "%s/ooc-C-%d.dat", dir, (int)getpid());
+  if (write_matrix_file(a_path, m, k, 1) ||
+      write_matrix_file(b_path, k, n, 1) ||
+      write_matrix_file(c_path, m, n, 0)) {
+    status = 1;
+    goto done;
+  }
 
   flop = 2.0*(double)m*(double)n*(double)k;
-  time = DBL_MAX;
-    
-  if (m*n < 10000) {
-    /* For small matrices, run in a loop, to help with timing variability. */
-    repeats = 50;
+  start = bench_timestamp();
+  if (ooc_gemm(m, n, k, a_path, b_path, c_path, budget)) {
+    status = 1;
+    goto done;
+  }
+  time = bench_timestamp() - start;
+
+  if (check) {
+    const double *a = map_matrix_file(a_path, (size_t)m*k*sizeof(double));
+    const double *b = map_matrix_file(b_path, (size_t)k*n*sizeof(double));
+    const double *c = map_matrix_file(c_path, (size_t)m*n*sizeof(double));
+    double maxdiff;
+    if (!a || !b || !c) {
+      fprintf(stderr, "Could not map the result files\n");
+      status = 1;
+    } else if (check_randomised(m, n, k, a, m, b, k, c, m, 1, &maxdiff)) {
+      fprintf(stderr, "OOC CHECK FAILED, maximum difference %g\n", maxdiff);
+      status = 1;
+    } else {
+      printf("OOC CHECK SUCCEEDED\n");
+    }
+    if (a)
+      munmap((void *)a, (size_t)m*k*sizeof(double));
+    if (b)
+      munmap((void *)b, (size_t)k*n*sizeof(double));
+    if (c)
+      munmap((void *)c, (size_t)m*n*sizeof(double));
   } else {
-    repeats = 2;
+    if (!getenv("OOC_NO_INMEM")) {
+      double *a = NULL;
+      double *b = NULL;
+      double *c = NULL;
+      alloc_matrix(m, k, &a);
+      alloc_matrix(k, n, &b);
+      alloc_matrix(m, n, &c);
+      random_matrix(m, k, a, m);
+      random_matrix(k, n, b, k);
+      zero_matrix(m, n, c, m);
+      memtime = time_gemm("OOC", "in-memory", m, n, k, &optimised_gemm, a, m, b, k, c, m);
+      free_matrix(&a);
+      free_matrix(&b);
+      free_matrix(&c);
+    }
+    BenchResult result;
+    char params[64];
+    printf("%d %d %d %g %g %g %g\n", m, n, k, time, flop/time,
+           memtime, memtime > 0 ? flop/memtime : 0);
+    /* The inputs have to come from disk, so this is a single sample */
+    bench_stats(&time, 1, 1, "s", &result);
+    snprintf(params, sizeof(params), "variant=ooc m=%d n=%d k=%d", m, n, k);
+    bench_report("gemm/OOC", params, &result, flop, "FLOP");
   }
+ done:
+  unlink(a_path);
+  unlink(b_path);
+  unlink(c_path);
+  return status;
+}
+
+typedef struct BatchArgs {
+  int m, n, k, batch, loop;
+  const double *a, *b;
+  double *c;
+} BatchArgs;
+
+/* The batch with batched_gemm_strided, or with a loop if loop is set */
+static double batch_time(void *ctx, size_t reps)
+{
+  BatchArgs *bt = ctx;
+  const int lda = bt->m, ldb = bt->k, ldc = bt->m;
+  const long sa = (long)lda*bt->k, sb = (long)ldb*bt->n, sc = (long)ldc*bt->n;
+  double start = bench_timestamp();
+  size_t r;
+  int l;
 
-  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
-  for (i = 0; i < repeats; i++) {
-    gemm(m, n, k,
-         (const double *)a, lda,
-         (const double *)b, ldb,
-         c, ldc);
+  for (r = 0; r < reps; r++) {
+    if (bt->loop) {
+      for (l = 0; l < bt->batch; l++)
+        optimised_gemm(bt->m, bt->n, bt->k, bt->a + l*sa, lda, bt->b + l*sb, ldb,
+                       bt->c + l*sc, ldc);
+    } else {
+      batched_gemm_strided(bt->m, bt->n, bt->k, bt->a, lda, sa, bt->b, ldb, sb,
+                           bt->c, ldc, sc, bt->batch);
+    }
   }
-  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
-  time = diff_time(end, start) / repeats;
-  printf("%d %d %d %g %g %g\n", m, n, k, time, flop, flop/time);
+  return bench_timestamp() - start;
+}
+
+/*
+ * Benchmark the batched small matrix gemm.
+ * m, n, k: matrix sizes of every problem in the batch
+ * batch: number of problems
+ * prints:
+ *  m n k BATCH TIME FLOP FLOP/s LOOPTIME LOOPFLOP/s
+ * where the LOOP columns are for calling optimised_gemm on each
+ * problem in turn, and the times are medians.
+ * Times are wall clock, since the batch is run in parallel.
+ */
+static void bench_batched(int m, int n, int k, int batch)
+{
+  double *a = NULL;
+  double *b = NULL;
+  double *c = NULL;
+  double flop;
+  long sa, sb, sc;
+  BatchArgs args;
+  BenchResult result, loopresult;
+  char params[96];
+
+  sa = (long)m*k;
+  sb = (long)k*n;
+  sc = (long)m*n;
+
+  alloc_matrix(sa, batch, &a);
+  alloc_matrix(sb, batch, &b);
+  alloc_matrix(sc, batch, &c);
+
+  random_matrix(sa, batch, a, sa);
+  random_matrix(sb, batch, b, sb);
+  zero_matrix(sc, batch, c, sc);
+
+  flop = 2.0*(double)m*(double)n*(double)k*(double)batch;
+
+  /* The calibration also faults in the pages on the threads that will
+   * use them */
+  args.m = m;
+  args.n = n;
+  args.k = k;
+  args.batch = batch;
+  args.a = a;
+  args.b = b;
+  args.c = c;
+  args.loop = 0;
+  bench_run(batch_time, &args, &result);
+  args.loop = 1;
+  bench_run(batch_time, &args, &loopresult);
+
+  printf("%d %d %d %d %g %g %g %g %g\n", m, n, k, batch,
+         result.median, flop, flop/result.median, loopresult.median, flop/loopresult.median);
+  snprintf(params, sizeof(params), "variant=batched m=%d n=%d k=%d batch=%d", m, n, k, batch);
+  bench_report("gemm/BATCH", params, &result, flop, "FLOP");
+  snprintf(params, sizeof(params), "variant=loop m=%d n=%d k=%d batch=%d", m, n, k, batch);
+  bench_report("gemm/BATCH", params, &loopresult, flop, "FLOP");
   free_matrix(&a);
   free_matrix(&b);
   free_matrix(&c);
 }
 
+/*
+ * Workspace for the STRASSEN benchmark, allocated once, so that the
+ * timings don't include allocating and faulting it in on every call
+ * as strassen_gemm does.
+ */
+static double *strassen_work;
+
+static void strassen_gemm_prealloc(int m, int n, int k,
+                                   const double *A, int lda,
+                                   const double *B, int ldb,
+                                   double *C, int ldc)
+{
+  strassen_gemm_ws(m, n, k, A, lda, B, ldb, C, ldc, strassen_work);
+}
+
 int main(int argc, char **argv)
 {
   int m, n, k;
-  if (argc != 5) {
+  int status = 0;
+  if (argc != 5 && !(argc == 6 && !strcmp(argv[4], "BATCH"))) {
     fprintf(stderr, "Invalid arguments.\n");
-    fprintf(stderr, "Usage: %s M N K mode\n", argv[0]);
+    fprintf(stderr, "Usage: %s M N K mode [batch]\n", argv[0]);
     fprintf(stderr, "Where M, N, and K are the dimensions of the problem.\n");
-    fprintf(stderr, "'mode' is one of BENCH or CHECK\n");
+    fprintf(stderr, "'mode' is one of BENCH, CHECK, REFERENCE, SHAPES, BATCH, STRASSEN, STRASSEN_CHECK,\n");
+    fprintf(stderr, "SBENCH, SCHECK, ZBENCH, ZCHECK (S: single precision, Z: double complex),\n");
+    fprintf(stderr, "EPILOGUE, EPILOGUE_CHECK (fused bias, scaling, and clamp),\n");
+    fprintf(stderr, "CHOLESKY, CHOLESKY_CHECK (M is the matrix size, N the tile size),\n");
+    fprintf(stderr, "OOC, or OOC_CHECK (out of core, see OOC_DIR and OOC_BUDGET_MB)\n");
+    fprintf(stderr, "'batch' is the number of problems for BATCH mode (default 10000)\n");
     return 1;
   }
 
@@ -251,26 +906,118 @@ int main(int argc, char **argv)
   LIKWID_MARKER_THREADINIT;
   LIKWID_MARKER_REGISTER("BASIC_DGEMM");
   LIKWID_MARKER_REGISTER("OPTIMISED_DGEMM");
+  LIKWID_MARKER_REGISTER("OPTIMISED_SGEMM");
+  LIKWID_MARKER_REGISTER("OPTIMISED_ZGEMM");
+  LIKWID_MARKER_REGISTER("BATCHED_GEMM");
+  LIKWID_MARKER_REGISTER("STRASSEN_GEMM");
+  LIKWID_MARKER_REGISTER("CHOLESKY");
+  LIKWID_MARKER_REGISTER("OOC_GEMM");
   /* A is m x k; B is k x n; C is m x n. */
   m = atoi(argv[1]);
   n = atoi(argv[2]);
   k = atoi(argv[3]);
 
   if (!strcmp(argv[4], "BENCH")) {
-    bench(m, n, k, &optimised_gemm);
+    bench(m, n, k, &optimised_gemm, "BENCH");
   } else if (!strcmp(argv[4], "CHECK")) {
     double maxdiff;
-    int val = check(m, n, k, &optimised_gemm, &maxdiff);
+    int val = check(m, n, k, &optimised_gemm, 1, &maxdiff);
     if (val) {
       fprintf(stderr, "CHECK FAILED, maximum entry difference %g\n", maxdiff);
+      status = 1;
     } else {
       printf("CHECK SUCCEEDED\n");
     }
+    /* The batched kernels are only meant for small matrices */
+    if ((double)m*n*k <= EXACT_CHECK_LIMIT) {
+      val = check(m, n, k, &single_batched_gemm, 1, &maxdiff);
+      if (val) {
+        fprintf(stderr, "BATCHED CHECK FAILED, maximum entry difference %g\n", maxdiff);
+        status = 1;
+      } else {
+        printf("BATCHED CHECK SUCCEEDED\n");
+      }
+    }
+  } else if (!strcmp(argv[4], "SBENCH")) {
+    s_bench(m, n, k, &optimised_sgemm, "SBENCH");
+  } else if (!strcmp(argv[4], "SCHECK")) {
+    double maxdiff;
+    if (s_check(m, n, k, &optimised_sgemm, 1, &maxdiff)) {
+      fprintf(stderr, "SGEMM CHECK FAILED, maximum entry difference %g\n", maxdiff);
+      status = 1;
+    } else {
+      printf("SGEMM CHECK SUCCEEDED\n");
+    }
+  } else if (!strcmp(argv[4], "ZBENCH")) {
+    z_bench(m, n, k, &optimised_zgemm, "ZBENCH");
+  } else if (!strcmp(argv[4], "ZCHECK")) {
+    double maxdiff;
+    if (z_check(m, n, k, &optimised_zgemm, 1, &maxdiff)) {
+      fprintf(stderr, "ZGEMM CHECK FAILED, maximum entry difference %g\n", maxdiff);
+      status = 1;
+    } else {
+      printf("ZGEMM CHECK SUCCEEDED\n");
+    }
+  } else if (!strcmp(argv[4], "STRASSEN")) {
+    /* Effective FLOP/s, i.e. against 2mnk, not the flops performed */
+    const size_t size = strassen_workspace_size(m, n, k);
+    strassen_work = alloc_aligned((size ? size : 1)*sizeof(*strassen_work));
+    /* First touch outside the timings */
+    memset(strassen_work, 0, (size ? size : 1)*sizeof(*strassen_work));
+    bench(m, n, k, &strassen_gemm_prealloc, "STRASSEN");
+    free(strassen_work);
+    strassen_work = NULL;
+  } else if (!strcmp(argv[4], "STRASSEN_CHECK")) {
+    double maxdiff, strassendiff;
+    int val;
+    /* Same inputs for both */
+    srand48(0);
+    check(m, n, k, &optimised_gemm, 1, &maxdiff);
+    srand48(0);
+    val = check(m, n, k, &strassen_gemm, strassen_error_factor(m, n, k), &strassendiff);
+    printf("Maximum entry difference: optimised %g Strassen %g\n", maxdiff, strassendiff);
+    if (val) {
+      fprintf(stderr, "STRASSEN CHECK FAILED\n");
+      status = 1;
+    } else {
+      printf("STRASSEN CHECK SUCCEEDED\n");
+    }
+  } else if (!strcmp(argv[4], "EPILOGUE")) {
+    bench_epilogue(m, n, k);
+  } else if (!strcmp(argv[4], "EPILOGUE_CHECK")) {
+    double maxdiff;
+    if (check_epilogue(m, n, k, &maxdiff)) {
+      fprintf(stderr, "EPILOGUE CHECK FAILED, maximum entry difference %g\n", maxdiff);
+      status = 1;
+    } else {
+      printf("EPILOGUE CHECK SUCCEEDED\n");
+    }
+  } else if (!strcmp(argv[4], "CHOLESKY")) {
+    bench_cholesky(m, n);
+  } else if (!strcmp(argv[4], "CHOLESKY_CHECK")) {
+    double residual;
+    if (check_cholesky(m, n, &residual)) {
+      fprintf(stderr, "CHOLESKY CHECK FAILED, relative residual %g\n", residual);
+      status = 1;
+    } else {
+      printf("Relative residual %g\n", residual);
+      printf("CHOLESKY CHECK SUCCEEDED\n");
+    }
+  } else if (!strcmp(argv[4], "OOC")) {
+    status = run_ooc(m, n, k, 0);
+  } else if (!strcmp(argv[4], "OOC_CHECK")) {
+    status = run_ooc(m, n, k, 1);
+  } else if (!strcmp(argv[4], "SHAPES")) {
+    bench_shapes(m, n, k);
+  } else if (!strcmp(argv[4], "REFERENCE")) {
+    status = bench_reference(m, n, k);
+  } else if (!strcmp(argv[4], "BATCH")) {
+    bench_batched(m, n, k, argc == 6 ? atoi(argv[5]) : 10000);
   } else {
-    fprintf(stderr, "Unrecognised mode %s, should be BENCH or CHECK\n", argv[4]);
+    fprintf(stderr, "Unrecognised mode %s, should be BENCH, CHECK, REFERENCE, SHAPES, BATCH, STRASSEN, STRASSEN_CHECK, SBENCH, SCHECK, ZBENCH, ZCHECK, EPILOGUE, EPILOGUE_CHECK, CHOLESKY, CHOLESKY_CHECK, OOC, or OOC_CHECK\n", argv[4]);
     LIKWID_MARKER_CLOSE;
     return 1;
   }
   LIKWID_MARKER_CLOSE;
-  return 0;
+  return status;
 }
@@ -0,0 +1,309 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../../common/bench.h"
+
+/*
+ * Throughput of the micro kernel on its own.
+ *
+ * For each MR x NR shape the gemm micro kernel is called in a loop on
+ * one packed panel of A and one of B, small enough to stay in L1, so
+ * that there is no memory traffic to hide and what we see is the
+ * quality of the register blocking. We report multiply-adds per cycle
+ * and the fraction of the peak, VECTOR_DOUBLES * FMA_UNITS.
+ *
+ * Cycles are core cycles from perf_event_open if we are allowed to
+ * use it. Otherwise we fall back to the time stamp counter, which
+ * ticks at a constant rate: if the core runs faster than that (turbo)
+ * the fraction of peak can be above one, if slower, below.
+ *
+ * The default KC = 96 keeps the panels of the largest shape, 32 x 4,
+ * within a 32 KB L1.
+ *
+ * The calls are timed in repetitions of CALLS calls with
+ * ../../common/bench.h, counting the cycles of each sample. We report
+ * the fastest sample, since in L1 anything slower is interference,
+ * and the benchmark records have the other statistics, in cycles.
+ *
+ * Usage: kernel-bench [KC [CALLS]]
+ */
+
+#include "parameters.h"
+
+#define KERNEL_NAME_(f, m, n) f##_##m##x##n
+#define KERNEL_NAME(f, m, n) KERNEL_NAME_(f, m, n)
+
+/* Doubles per vector register for the instruction set we compiled for */
+#ifndef VECTOR_DOUBLES
+#if defined(__AVX512F__)
+#define VECTOR_DOUBLES 8
+#elif defined(__AVX__)
+#define VECTOR_DOUBLES 4
+#elif defined(__SSE2__) || defined(__ARM_NEON)
+#define VECTOR_DOUBLES 2
+#else
+#define VECTOR_DOUBLES 1
+#endif
+#endif
+
+/* Vector FMA instructions issued per cycle */
+#ifndef FMA_UNITS
+#define FMA_UNITS 2
+#endif
+
+#define KMR 1
+#define KNR 1
+#include "kernel-variant.c"
+#define KMR 4
+#define KNR 4
+#include "kernel-variant.c"
+#define KMR 8
+#define KNR 4
+#include "kernel-variant.c"
+#define KMR 4
+#define KNR 8
+#include "kernel-variant.c"
+#define KMR 8
+#define KNR 6
+#include "kernel-variant.c"
+#define KMR 8
+#define KNR 8
+#include "kernel-variant.c"
+#define KMR 12
+#define KNR 4
+#include "kernel-variant.c"
+#define KMR 16
+#define KNR 4
+#include "kernel-variant.c"
+#define KMR 16
+#define KNR 6
+#include "kernel-variant.c"
+#define KMR 24
+#define KNR 4
+#include "kernel-variant.c"
+#define KMR 24
+#define KNR 8
+#include "kernel-variant.c"
+#define KMR 32
+#define KNR 4
+#include "kernel-variant.c"
+
+typedef void (*run_fn_t)(int, const double *, const double *, double *, long);
+
+static const struct {
+  int mr, nr;
+  run_fn_t run;
+} variants[] = {
+  {1, 1, run_1x1},
+  {4, 4, run_4x4},
+  {8, 4, run_8x4},
+  {4, 8, run_4x8},
+  {8, 6, run_8x6},
+  {8, 8, run_8x8},
+  {12, 4, run_12x4},
+  {16, 4, run_16x4},
+  {16, 6, run_16x6},
+  {24, 4, run_24x4},
+  {24, 8, run_24x8},
+  {32, 4, run_32x4},
+};
+
+/* The kernel from ../micro-kernel.c, see exercise-kernel.c */
+void micro_kernel(int, const double *restrict, const double *restrict,
+                  double *restrict);
+extern const int exercise_mr, exercise_nr;
+
+static void run_exercise(int kc, const double *A, const double *B,
+                         double *C, long calls)
+{
+  long c;
+  for (c = 0; c < calls; c++)
+    micro_kernel(kc, A, B, C);
+}
+
+static int perf_fd = -1;
+
+/*
+ * Open a counter for the core cycles of this thread in user mode.
+ * Returns 0 on success, 1 if perf events are not available (no
+ * kernel support, or perf_event_paranoid forbids it).
+ */
+static int open_cycle_counter(void)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CPU_CYCLES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  perf_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  return perf_fd < 0;
+}
+
+static uint64_t read_cycles(void)
+{
+  if (perf_fd >= 0) {
+    uint64_t count;
+    if (read(perf_fd, &count, sizeof(count)) != sizeof(count))
+      return 0;
+    return count;
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec*1000000000 + t.tv_nsec;
+  }
+#endif
+}
+
+static void *alloc_aligned(size_t bytes)
+{
+  void *ptr;
+  switch (posix_memalign(&ptr, 64, bytes)) {
+  case 0:
+    return ptr;
+  case EINVAL:
+    fprintf(stderr, "Alignment not power of two\n");
+    exit(1);
+  case ENOMEM:
+    fprintf(stderr, "Insufficient memory\n");
+    exit(1);
+  default:
+    fprintf(stderr, "Unknown error\n");
+    exit(1);
+  }
+}
+
+typedef struct KernelArgs {
+  run_fn_t run;
+  int kc;
+  const double *A, *B;
+  double *C;
+  long calls;
+  size_t samples;
+  double cycles[BENCH_MAX_SAMPLES];
+} KernelArgs;
+
+/* reps times calls calls, keeping the cycles they took */
+static double kernel_time(void *ctx, size_t reps)
+{
+  KernelArgs *k = ctx;
+  uint64_t start, end;
+  double time;
+
+  if (perf_fd >= 0) {
+    ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  time = bench_timestamp();
+  start = read_cycles();
+  k->run(k->kc, k->A, k->B, k->C, k->calls*reps);
+  end = read_cycles();
+  time = bench_timestamp() - time;
+  if (perf_fd >= 0)
+    ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+  k->cycles[k->samples++ % BENCH_MAX_SAMPLES] = (double)(end - start);
+  return time;
+}
+
+/*
+ * Cycles per call of run(kc, A, B, C, calls), the fastest sample.
+ * A and B are filled with small values so that C stays finite.
+ */
+static double measure(run_fn_t run, int mr, int nr, int kc, long calls)
+{
+  KernelArgs *args = malloc(sizeof(*args));
+  double *A = alloc_aligned((size_t)mr*kc*sizeof(*A));
+  double *B = alloc_aligned((size_t)nr*kc*sizeof(*B));
+  double *C = alloc_aligned((size_t)mr*nr*sizeof(*C));
+  double cycles[BENCH_MAX_SAMPLES];
+  BenchResult result;
+  char params[64];
+  int i;
+
+  for (i = 0; i < mr*kc; i++)
+    A[i] = drand48() * 1e-3;
+  for (i = 0; i < nr*kc; i++)
+    B[i] = drand48() * 1e-3;
+  for (i = 0; i < mr*nr; i++)
+    C[i] = 0;
+
+  args->run = run;
+  args->kc = kc;
+  args->A = A;
+  args->B = B;
+  args->C = C;
+  args->calls = calls;
+  args->samples = 0;
+  bench_run(kernel_time, args, &result);
+  /* The samples are the last calls */
+  for (i = 0; i < result.samples; i++)
+    cycles[i] = args->cycles[(args->samples - result.samples + i) % BENCH_MAX_SAMPLES];
+  bench_stats(cycles, result.samples, result.reps*calls, "cycle", &result);
+  snprintf(params, sizeof(params), "mr=%d nr=%d kc=%d", mr, nr, kc);
+  bench_report("kernel-bench", params, &result, (double)mr*nr*kc, "FMA");
+  /* Keep the result live */
+  if (C[0] != C[0])
+    fprintf(stderr, "NaN in C\n");
+  free(args);
+  free(A);
+  free(B);
+  free(C);
+  return result.min;
+}
+
+static void report(int mr, int nr, int kc, double cycles)
+{
+  const double peak = VECTOR_DOUBLES * FMA_UNITS;
+  const double fma = (double)mr*nr*kc / cycles;
+  printf("%d %d %d %g %g %g %g\n", mr, nr, kc, cycles, fma, peak,
+         fma / peak);
+}
+
+int main(int argc, char **argv)
+{
+  int kc = argc > 1 ? atoi(argv[1]) : 96;
+  long calls = argc > 2 ? atol(argv[2]) : 20000;
+  size_t v;
+
+  if (argc > 3 || kc < 1 || calls < 1) {
+    fprintf(stderr, "Usage: %s [KC [CALLS]]\n", argv[0]);
+    return 1;
+  }
+  if (open_cycle_counter())
+    fprintf(stderr, "perf_event_open failed (%s), counting cycles with %s\n",
+            strerror(errno),
+#if defined(__x86_64__) || defined(__i386__)
+            "the time stamp counter"
+#else
+            "nanoseconds"
+#endif
+            );
+  printf("# MR NR KC CYCLES FMA/CYCLE PEAK FRACTION\n");
+  for (v = 0; v < sizeof(variants)/sizeof(variants[0]); v++)
+    report(variants[v].mr, variants[v].nr, kc,
+           measure(variants[v].run, variants[v].mr, variants[v].nr, kc, calls));
+  printf("# ../micro-kernel.c\n");
+  report(exercise_mr, exercise_nr, kc,
+         measure(&run_exercise, exercise_mr, exercise_nr, kc, calls));
+  if (perf_fd >= 0)
+    close(perf_fd);
+  return 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * One micro kernel variant for kernel-bench.c, which defines KMR and
+ * KNR and includes this file once per shape. We instantiate the same
+ * micro-kernel.c that optimised_gemm uses, with GEMM_MR = KMR and
+ * GEMM_NR = KNR, and a driver that calls it in a loop on one pair of
+ * packed panels.
+ */
+
+#define FLOAT double
+#define GEMM_MR KMR
+#define GEMM_NR KNR
+#define GEMM_CL CL_DOUBLES
+#define GEMM_FN(f) KERNEL_NAME(f, KMR, KNR)
+
+#include "micro-kernel.c"
+
+/*
+ * calls times C = C + A*B with the kc deep panels A (MR x kc) and B
+ * (kc x NR). C is MR x NR. The "next" tile of C is the panel of A,
+ * which is already in L1, so the prefetch in the kernel costs an
+ * instruction but no traffic.
+ */
+static void GEMM_FN(run)(int kc, const double *A, const double *B,
+                         double *C, long calls)
+{
+  long c;
+  for (c = 0; c < calls; c++)
+    GEMM_FN(micro_kernel)(kc, A, B, C, GEMM_MR, A);
+}
+
+#undef FLOAT
+#undef GEMM_MR
+#undef GEMM_NR
+#undef GEMM_CL
+#undef GEMM_FN
+#undef KMR
+#undef KNR
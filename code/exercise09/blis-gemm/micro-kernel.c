@@ -1,13 +1,23 @@
-#include "parameters.h"
+#ifndef GEMM_COMPLEX
 
-static inline void micro_kernel(int kc,
-                                const double * restrict A,
-                                const double * restrict B,
-                                double * restrict AB)
+static inline void GEMM_FN(micro_kernel)(int kc,
+                                         const FLOAT * restrict A,
+                                         const FLOAT * restrict B,
+                                         FLOAT * restrict C, int ldc,
+                                         const FLOAT * restrict C_next)
 {
-  /* Compute a little MR x NR output block in C. */
+  /* Compute a little MR x NR output block in C, C = C + A*B. The
+   * product is accumulated in AB (which should live in registers)
+   * and only added into C at the end. */
+  FLOAT AB[GEMM_MR*GEMM_NR] __attribute__((aligned(64))) = {0};
   int i, j, l;
 
+  /* Get the next tile of C on its way while we do the flops for this
+   * one. */
+  for (j = 0; j < GEMM_NR; ++j)
+    for (i = 0; i < GEMM_MR; i += GEMM_CL)
+      __builtin_prefetch(&C_next[i + j*ldc], 1);
+
   /*
     Different compilers have different unrolling/vectorisation pragmas
 
@@ -28,8 +38,118 @@ static inline void micro_kernel(int kc,
 
   /* For every "block" column */
   for (l = 0; l < kc; ++l)
-    for (j = 0; j < NR; ++j)
-      for (i = 0; i < MR; ++i)
+    for (j = 0; j < GEMM_NR; ++j)
+      for (i = 0; i < GEMM_MR; ++i)
         /* Multiply row of A into column of B. */
-        AB[i + j*MR] += A[i + MR*l] * B[j + NR*l];
+        AB[i + j*GEMM_MR] += A[i + GEMM_MR*l] * B[j + GEMM_NR*l];
+
+  for (j = 0; j < GEMM_NR; ++j)
+    for (i = 0; i < GEMM_MR; ++i)
+      C[i + j*ldc] += AB[i + j*GEMM_MR];
+}
+
+/*
+ * As micro_kernel, but for operands that may not be packed.
+ * A(i, l) is at A[i + l*lda], B(l, j) is at B[l*rsb + j*csb].
+ * A packed micro panel of A has lda = MR, a packed micro panel of B
+ * has rsb = NR, csb = 1. Since this is inlined, the strides are
+ * usually compile time constants at the call site.
+ */
+static inline void GEMM_FN(micro_kernel_strided)(int kc,
+                                                 const FLOAT * restrict A, int lda,
+                                                 const FLOAT * restrict B, int rsb, int csb,
+                                                 FLOAT * restrict C, int ldc)
+{
+  FLOAT AB[GEMM_MR*GEMM_NR] __attribute__((aligned(64))) = {0};
+  int i, j, l;
+
+  for (l = 0; l < kc; ++l)
+    for (j = 0; j < GEMM_NR; ++j)
+      for (i = 0; i < GEMM_MR; ++i)
+        AB[i + j*GEMM_MR] += A[i + lda*l] * B[l*rsb + j*csb];
+
+  for (j = 0; j < GEMM_NR; ++j)
+    for (i = 0; i < GEMM_MR; ++i)
+      C[i + j*ldc] += AB[i + j*GEMM_MR];
+}
+
+#else
+
+/*
+ * Complex micro kernels. Letting the compiler do complex arithmetic
+ * shuffles real and imaginary parts in the inner loop. Instead view
+ * each column of the A panel as 2*MR reals (re, im, re, im, ...) and
+ * accumulate A*Re(b) and A*Im(b) separately, which is plain real
+ * multiply-adds on contiguous data. The two are combined once, when
+ * adding into C:
+ *   Re(c) += Re(A Re(b)) - Im(A Im(b))
+ *   Im(c) += Im(A Re(b)) + Re(A Im(b))
+ */
+static inline void GEMM_FN(micro_kernel)(int kc,
+                                         const FLOAT * restrict A,
+                                         const FLOAT * restrict B,
+                                         FLOAT * restrict C, int ldc,
+                                         const FLOAT * restrict C_next)
+{
+  const GEMM_REAL *a = (const GEMM_REAL *)A;
+  const GEMM_REAL *b = (const GEMM_REAL *)B;
+  GEMM_REAL ABr[2*GEMM_MR*GEMM_NR] __attribute__((aligned(64))) = {0};
+  GEMM_REAL ABi[2*GEMM_MR*GEMM_NR] __attribute__((aligned(64))) = {0};
+  int i, j, l;
+
+  for (j = 0; j < GEMM_NR; ++j)
+    for (i = 0; i < GEMM_MR; i += GEMM_CL)
+      __builtin_prefetch(&C_next[i + j*ldc], 1);
+
+  for (l = 0; l < kc; ++l)
+    for (j = 0; j < GEMM_NR; ++j) {
+      const GEMM_REAL br = b[2*(j + GEMM_NR*l)];
+      const GEMM_REAL bi = b[2*(j + GEMM_NR*l) + 1];
+      for (i = 0; i < 2*GEMM_MR; ++i) {
+        ABr[i + j*2*GEMM_MR] += a[i + 2*GEMM_MR*l] * br;
+        ABi[i + j*2*GEMM_MR] += a[i + 2*GEMM_MR*l] * bi;
+      }
+    }
+
+  for (j = 0; j < GEMM_NR; ++j) {
+    GEMM_REAL *c = (GEMM_REAL *)&C[j*ldc];
+    for (i = 0; i < GEMM_MR; ++i) {
+      c[2*i] += ABr[2*i + j*2*GEMM_MR] - ABi[2*i + 1 + j*2*GEMM_MR];
+      c[2*i + 1] += ABr[2*i + 1 + j*2*GEMM_MR] + ABi[2*i + j*2*GEMM_MR];
+    }
+  }
 }
+
+/* As micro_kernel, but for operands that may not be packed, with the
+ * strides (in complex elements) of the real micro_kernel_strided. */
+static inline void GEMM_FN(micro_kernel_strided)(int kc,
+                                                 const FLOAT * restrict A, int lda,
+                                                 const FLOAT * restrict B, int rsb, int csb,
+                                                 FLOAT * restrict C, int ldc)
+{
+  const GEMM_REAL *a = (const GEMM_REAL *)A;
+  const GEMM_REAL *b = (const GEMM_REAL *)B;
+  GEMM_REAL ABr[2*GEMM_MR*GEMM_NR] __attribute__((aligned(64))) = {0};
+  GEMM_REAL ABi[2*GEMM_MR*GEMM_NR] __attribute__((aligned(64))) = {0};
+  int i, j, l;
+
+  for (l = 0; l < kc; ++l)
+    for (j = 0; j < GEMM_NR; ++j) {
+      const GEMM_REAL br = b[2*(l*rsb + j*csb)];
+      const GEMM_REAL bi = b[2*(l*rsb + j*csb) + 1];
+      for (i = 0; i < 2*GEMM_MR; ++i) {
+        ABr[i + j*2*GEMM_MR] += a[i + 2*lda*l] * br;
+        ABi[i + j*2*GEMM_MR] += a[i + 2*lda*l] * bi;
+      }
+    }
+
+  for (j = 0; j < GEMM_NR; ++j) {
+    GEMM_REAL *c = (GEMM_REAL *)&C[j*ldc];
+    for (i = 0; i < GEMM_MR; ++i) {
+      c[2*i] += ABr[2*i + j*2*GEMM_MR] - ABi[2*i + 1 + j*2*GEMM_MR];
+      c[2*i + 1] += ABr[2*i + 1 + j*2*GEMM_MR] + ABi[2*i + j*2*GEMM_MR];
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,225 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Out-of-core gemm, C = C + A*B, for matrices stored in files.
+ *
+ * Each file holds a column major matrix of doubles, without padding
+ * (so the leading dimension is the number of rows). The files are
+ * mapped, and the product is done in super-blocks that fit in a memory
+ * budget:
+ *
+ *   for each panel of ns columns of C and B
+ *     for each panel of ks columns of A (and rows of B)
+ *       C(:, J) += A(:, L) * B(L, J)      with optimised_gemm
+ *
+ * A column panel of C or A is contiguous in its file, and the block of
+ * B is ns runs of ks contiguous entries. The C panel stays resident
+ * while the panels of A stream past it, so each byte of A read from
+ * disk is used for 2 ns flops.
+ *
+ * Before computing on one super-block we madvise(MADV_WILLNEED) the
+ * next, so the kernel reads it ahead while we compute. Super-blocks
+ * we are done with are dropped with MADV_DONTNEED (C is first written
+ * back), so the resident set stays within the budget.
+ */
+
+#include "likwidinc.h"
+
+void optimised_gemm(int, int, int,
+                    const double *, int,
+                    const double *, int,
+                    double *, int);
+
+typedef struct {
+  void *ptr;
+  size_t bytes;
+} mapping_t;
+
+static size_t page_size(void)
+{
+  static size_t size = 0;
+  if (!size)
+    size = sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+/*
+ * Apply advice to the pages covering [p, p + bytes). madvise wants a
+ * page aligned start, so round outwards.
+ */
+static void advise(const void *p, size_t bytes, int advice)
+{
+  uintptr_t start = (uintptr_t)p & ~(page_size() - 1);
+  uintptr_t end = (uintptr_t)p + bytes;
+  if (bytes)
+    (void)madvise((void *)start, end - start, advice);
+}
+
+/* Start writing back the pages covering [p, p + bytes). */
+static void write_back(const void *p, size_t bytes)
+{
+  uintptr_t start = (uintptr_t)p & ~(page_size() - 1);
+  uintptr_t end = (uintptr_t)p + bytes;
+  if (bytes && msync((void *)start, end - start, MS_ASYNC))
+    perror("msync");
+}
+
+/* Advice for the ks x ns block of B starting at B(l, j). */
+static void advise_b(const double *B, int ldb, int l, int j, int ks, int ns,
+                     int advice)
+{
+  int jj;
+  if (ks == ldb || (size_t)ks*sizeof(*B) < page_size()) {
+    /* Contiguous, or too short to be worth skipping the gaps */
+    advise(&B[(size_t)j*ldb + l], ((size_t)(ns - 1)*ldb + ks)*sizeof(*B), advice);
+  } else {
+    for (jj = 0; jj < ns; jj++)
+      advise(&B[(size_t)(j + jj)*ldb + l], (size_t)ks*sizeof(*B), advice);
+  }
+}
+
+static int map_file(const char *path, size_t bytes, int writable,
+                    mapping_t *map)
+{
+  struct stat st;
+  int fd = open(path, writable ? O_RDWR : O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return 1;
+  }
+  if (fstat(fd, &st) || (size_t)st.st_size < bytes) {
+    fprintf(stderr, "%s: expected at least %zu bytes\n", path, bytes);
+    close(fd);
+    return 1;
+  }
+  map->bytes = bytes;
+  map->ptr = mmap(NULL, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                  MAP_SHARED, fd, 0);
+  close(fd);
+  if (map->ptr == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Choose the super-block sizes. C(:, J) takes up to half the budget,
+ * and the rest holds two (current and next) panels of A and blocks of
+ * B.
+ */
+static void super_blocks(int m, int n, int k, size_t budget,
+                         int *ns, int *ks)
+{
+  size_t words = budget / sizeof(double);
+  size_t nsw = words / 2 / m;
+  size_t ksw;
+  *ns = nsw < 1 ? 1 : nsw > (size_t)n ? n : (int)nsw;
+  if (words <= (size_t)m * *ns)
+    ksw = 1;
+  else
+    ksw = (words - (size_t)m * *ns) / (2*((size_t)m + *ns));
+  *ks = ksw < 1 ? 1 : ksw > (size_t)k ? k : (int)ksw;
+}
+
+/*
+ * Compute C = C + A*B, where A (m x k), B (k x n), and C (m x n) are
+ * stored in the named files, using about budget bytes of memory for
+ * the operands.
+ * Returns 0 on success, 1 on failure.
+ */
+int ooc_gemm(int m, int n, int k,
+             const char *a_path, const char *b_path, const char *c_path,
+             size_t budget)
+{
+  mapping_t amap, bmap, cmap;
+  const double *A, *B;
+  double *C;
+  int ns, ks, nb, kb;
+  int j, l;
+
+  if (map_file(a_path, (size_t)m*k*sizeof(double), 0, &amap))
+    return 1;
+  if (map_file(b_path, (size_t)k*n*sizeof(double), 0, &bmap)) {
+    munmap(amap.ptr, amap.bytes);
+    return 1;
+  }
+  if (map_file(c_path, (size_t)m*n*sizeof(double), 1, &cmap)) {
+    munmap(amap.ptr, amap.bytes);
+    munmap(bmap.ptr, bmap.bytes);
+    return 1;
+  }
+  A = amap.ptr;
+  B = bmap.ptr;
+  C = cmap.ptr;
+
+  /* We walk through each operand in order, but skip around at the
+   * ends of panels, so do our own read ahead. */
+  (void)madvise(amap.ptr, amap.bytes, MADV_RANDOM);
+  (void)madvise(bmap.ptr, bmap.bytes, MADV_RANDOM);
+  (void)madvise(cmap.ptr, cmap.bytes, MADV_RANDOM);
+
+  super_blocks(m, n, k, budget, &ns, &ks);
+  nb = (n + ns - 1) / ns;
+  kb = (k + ks - 1) / ks;
+  if (getenv("GEMM_VERBOSE"))
+    fprintf(stderr, "ooc_gemm super-blocks: %d x %d of C, %d x %d of A\n",
+            m, ns, m, ks);
+
+  LIKWID_MARKER_START("OOC_GEMM");
+  advise(C, (size_t)m*(n < ns ? n : ns)*sizeof(*C), MADV_WILLNEED);
+  advise(A, (size_t)m*(k < ks ? k : ks)*sizeof(*A), MADV_WILLNEED);
+  advise_b(B, k, 0, 0, k < ks ? k : ks, n < ns ? n : ns, MADV_WILLNEED);
+  for (j = 0; j < nb; j++) {
+    const int jj = j*ns;
+    const int nc = n - jj < ns ? n - jj : ns;
+    double *Cj = &C[(size_t)jj*m];
+
+    for (l = 0; l < kb; l++) {
+      const int ll = l*ks;
+      const int kc = k - ll < ks ? k - ll : ks;
+      const double *Al = &A[(size_t)ll*m];
+
+      /* Start reading the next super-block: the next panel of A (or
+       * the first, for the next panel of C), and the matching block
+       * of B, and, at the end of a C panel, the next one. */
+      if (l + 1 < kb || j + 1 < nb) {
+        const int nl = l + 1 < kb ? ll + ks : 0;
+        const int nj = l + 1 < kb ? jj : jj + ns;
+        const int nkc = k - nl < ks ? k - nl : ks;
+        const int nnc = n - nj < ns ? n - nj : ns;
+        advise(&A[(size_t)nl*m], (size_t)m*nkc*sizeof(*A), MADV_WILLNEED);
+        advise_b(B, k, nl, nj, nkc, nnc, MADV_WILLNEED);
+        if (l + 1 == kb)
+          advise(&C[(size_t)nj*m], (size_t)m*nnc*sizeof(*C), MADV_WILLNEED);
+      }
+
+      optimised_gemm(m, nc, kc, Al, m, &B[(size_t)jj*k + ll], k, Cj, m);
+
+      /* Unless A fits in one panel, it will be read again for the next
+       * panel of C, and must make room for the panels after it. */
+      if (kb > 1)
+        advise(Al, (size_t)m*kc*sizeof(*A), MADV_DONTNEED);
+      advise_b(B, k, ll, jj, kc, nc, MADV_DONTNEED);
+    }
+    /* Write back this panel of C and drop it */
+    write_back(Cj, (size_t)m*nc*sizeof(*C));
+    if (nb > 1)
+      advise(Cj, (size_t)m*nc*sizeof(*C), MADV_DONTNEED);
+  }
+  LIKWID_MARKER_STOP("OOC_GEMM");
+
+  munmap(amap.ptr, amap.bytes);
+  munmap(bmap.ptr, bmap.bytes);
+  if (msync(cmap.ptr, cmap.bytes, MS_SYNC))
+    perror("msync");
+  munmap(cmap.ptr, cmap.bytes);
+  return 0;
+}
@@ -1,6 +1,11 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <errno.h>
+#include <time.h>
+#include <complex.h>
+#include <sys/mman.h>
 
 /*
  * This implementation follows in part the UlmBLAS tutorial from
@@ -9,163 +14,121 @@
 
 #include "likwidinc.h"
 #include "parameters.h"
+#include "blocking.h"
+#include "epilogue.h"
 
-static void pack_A_full(int k,
-                        const double * restrict A, int lda,
-                        double * restrict buffer)
-{
-  int i, j;
+/* How far ahead (in columns of A, cache lines of B) the packing
+ * routines prefetch. */
+#ifndef PACK_PREFETCH_DIST
+#define PACK_PREFETCH_DIST 4
+#endif
 
-  for (j = 0; j < k; ++j)
-    for (i = 0; i < MR; ++i)
-      buffer[i + j*MR] = A[i + j*lda];
-}
+#define HUGE_PAGE_SIZE (2UL*1024*1024)
 
-static void pack_A(int m, int k,
-                   const double * restrict A, int lda,
-                   double * restrict buffer)
+/*
+ * Shape thresholds for skipping packing.
+ * - n <= SKINNY_N_MAX: B is only a few columns, read it in place.
+ * - k <= SKINNY_K_MAX: A is only a few columns, stream it in place.
+ * - m*n <= SMALL_MN_MAX: C is tiny, packing can't pay off.
+ * Streaming A in place was slower than packing it on the machines
+ * we've tried (packing A is cheap when k is small, and the micro
+ * kernel likes contiguous panels), so the skinny k path is off unless
+ * SKINNY_K_MAX is set at compile time.
+ */
+#ifndef SKINNY_N_MAX
+#define SKINNY_N_MAX 64
+#endif
+#ifndef SKINNY_K_MAX
+#define SKINNY_K_MAX 0
+#endif
+#ifndef SMALL_MN_MAX
+#define SMALL_MN_MAX (64*64)
+#endif
+
+static int shape_dispatch = 1;
+
+/*
+ * Turn the shape specific code paths on (the default) or off, so
+ * that they can be compared with the general blocked algorithm.
+ */
+void optimised_gemm_set_shape_dispatch(int on)
 {
-  int i, j;
-  int mp  = m / MR;
-  int _mr = m % MR;
-
-  for (i = 0; i < mp; ++i) {
-    /* Pack A, in row strips MR x k, column major order. */
-    pack_A_full(k, A, lda, buffer);
-    buffer += k*MR;
-    A += MR;
-  }
-  if (_mr) {
-    /* Cleanup code for non-full tile */
-    for (j = 0; j < k; ++j) {
-      for (i = 0; i < _mr; ++i)
-        buffer[i] = A[i];
-      for (i = _mr; i < MR; ++i)
-        buffer[i] = 0.0;
-      buffer += MR;
-      A += lda;
-    }
-  }
+  shape_dispatch = on;
 }
 
-static void pack_B_full(int k,
-                        const double * restrict B, int ldb,
-                        double * restrict buffer)
-{
-  int i, j;
+/*
+ * Time spent packing, and in optimised_gemm overall, in nanoseconds.
+ * Updated atomically, since we may be called from several threads.
+ */
+static uint64_t pack_ns = 0;
+static uint64_t total_ns = 0;
 
-  for (i = 0; i < k; ++i)
-    for (j = 0; j < NR; ++j)
-      buffer[j + i*NR] = B[j*ldb + i];
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000UL + ts.tv_nsec;
 }
 
-static void pack_B(int k, int n,
-                   const double * restrict B, int ldb,
-                   double * restrict buffer)
+/*
+ * Return the time spent (in seconds) packing, and in optimised_gemm
+ * overall, since the last call to optimised_gemm_reset_timers.
+ */
+void optimised_gemm_timers(double *pack, double *total)
 {
-  int i, j;
-  int np  = n / NR;
-  int _nr = n % NR;
-
-  for (j = 0; j < np; ++j) {
-    /* Pack B, in column strips kc x NR, row major order. */
-    pack_B_full(k, B, ldb, buffer);
-    buffer += k*NR;
-    B += NR*ldb;
-  }
-  
-  if (_nr) {
-    /* Cleanup code for non full tile. */
-    for (i = 0; i < k; ++i) {
-      for (j = 0; j < _nr; ++j)
-        buffer[j] = B[j*ldb];
-      for (j = _nr; j < NR; ++j)
-        buffer[j] = 0.0;
-      buffer += NR;
-      B += 1;
-    }
-  }
+  *pack = 1e-9*__atomic_load_n(&pack_ns, __ATOMIC_RELAXED);
+  *total = 1e-9*__atomic_load_n(&total_ns, __ATOMIC_RELAXED);
 }
 
-#include "micro-kernel.c"
-
-static void macro_kernel(int mc, int nc, int kc,
-                         double * restrict _A,
-                         double * restrict _B,
-                         double * restrict C, int ldc)
+void optimised_gemm_reset_timers(void)
 {
-  int i, j;
-  int mp = (mc+MR-1) / MR;
-  int np = (nc+NR-1) / NR;
-
-  int _mr = mc % MR;
-  int _nr = nc % NR;
-
-
-  for (j = 0; j < np; ++j) {
-    /* Only the last iteration might not be a full tile */
-    int nr = (j != np-1 || _nr == 0) ? NR : _nr;
-
-    for (i = 0; i < mp; ++i) {
-      int k, l;
-      int mr = (i != mp-1 || _mr == 0) ? MR : _mr;
-      double _C[MR*NR] __attribute__((aligned(64))) = {0};
-
-      /* Multiply into temporary */
-      micro_kernel(kc, &_A[i*kc*MR], &_B[j*kc*NR], _C);
-
-      /* Update output matrix. Do this separately for better locality
-       * in the hot inner loop: AB can live in registers in the micro
-       * kernel. */
-      for (k = 0; k < nr; ++k)
-        for (l = 0; l < mr; ++l)
-          C[i*MR + j*NR*ldc + k*ldc + l] += _C[k*MR + l];
-    }
-  }
+  __atomic_store_n(&pack_ns, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&total_ns, 0, __ATOMIC_RELAXED);
 }
 
-void optimised_gemm(int m, int n, int k,
-                    const double * restrict A, int lda,
-                    const double * restrict B, int ldb,
-                    double * restrict C, int ldc)
+/*
+ * A packing buffer. For large KC x NC the packed panel of B spans
+ * hundreds of 4KiB pages, so we try to back it with 2MiB pages to
+ * avoid DTLB misses. First try explicit huge pages (only available
+ * if the administrator has reserved some), then ask for transparent
+ * huge pages, and otherwise live with normal pages.
+ *
+ * Faulting in huge pages is expensive, so the buffers are kept (per
+ * thread) between calls, and only reallocated if they are too small.
+ */
+typedef struct {
+  void *ptr;
+  size_t bytes;
+  int mmapped;
+} packing_buffer_t;
+
+static void alloc_packing_buffer(size_t bytes, const char *name,
+                                 packing_buffer_t *buf)
 {
-  /*
-   * Local buffers for storing panels from A, and B.
-   */
-  double *_A = NULL;
-  double *_B = NULL;
-
-  int i, j, l, err;
-
-  /* Number of full blocks */
-  int mb = (m+MC-1) / MC;
-  int nb = (n+NC-1) / NC;
-  int kb = (k+KC-1) / KC;
-
-  /* Clean up tiles */  
-  int _mc = m % MC;  
-  int _nc = n % NC;
-  int _kc = k % KC;
-  LIKWID_MARKER_START("OPTIMISED_GEMM");
-
-  err = posix_memalign((void**)&_A, 64, sizeof(*_A)*((MC / MR)*MR + (MC % MR ? MR : 0))*KC);
-  if (err) {
-    fprintf(stderr, "posix_memalign for _A failed: ");
-    switch (err) {
-    case EINVAL:
-      fprintf(stderr, "alignment is not a power of 2\n");
-      break;
-    case ENOMEM:
-      fprintf(stderr, "memory allocation error\n");
-      break;
-    default:
-      fprintf(stderr, "reason unknown\n");
+  size_t align = 64;
+  int err;
+  buf->mmapped = 0;
+  /* Small buffers are covered by a handful of pages anyway, and a huge
+   * page would cost more to fault in than it saves. */
+  if (bytes >= HUGE_PAGE_SIZE / 2) {
+    /* Round up to a whole number of huge pages */
+    bytes = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    align = HUGE_PAGE_SIZE;
+  }
+  buf->bytes = bytes;
+#ifdef MAP_HUGETLB
+  if (align == HUGE_PAGE_SIZE) {
+    buf->ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (buf->ptr != MAP_FAILED) {
+      buf->mmapped = 1;
+      return;
     }
-    exit(1);
   }
-  err = posix_memalign((void**)&_B, 64, sizeof(*_B)*KC*((NC / NR)*NR + (NC % NR ? NR : 0)));
+#endif
+  err = posix_memalign(&buf->ptr, align, bytes);
   if (err) {
-    fprintf(stderr, "posix_memalign for _B failed: ");
+    fprintf(stderr, "posix_memalign for %s failed: ", name);
     switch (err) {
     case EINVAL:
       fprintf(stderr, "alignment is not a power of 2\n");
@@ -178,30 +141,110 @@ void optimised_gemm(int m, int n, int k,
     }
     exit(1);
   }
+#ifdef MADV_HUGEPAGE
+  /* Failure is fine, we just get normal pages. */
+  if (align == HUGE_PAGE_SIZE)
+    (void)madvise(buf->ptr, bytes, MADV_HUGEPAGE);
+#endif
+}
 
-  for (j = 0; j < nb; ++j) {
-    /* Only the last iteration might not be a full tile */
-    int nc = (j != nb-1 || _nc == 0) ? NC : _nc;
-
-    for (l = 0; l < kb; ++l) {
-      /* Only the last iteration might not be a full tile */
-      int kc = (l != kb-1 || _kc == 0) ? KC : _kc;
-
-      /* Pack kc x nc long thin row of B */
-      pack_B(kc, nc, &B[l*KC + j*NC*ldb], ldb, _B);
-
-      for (i = 0; i < mb; ++i) {
-        /* Only the last iteration might not be a full tile */
-        int mc = (i != mb-1 || _mc == 0) ? MC : _mc;
+static void free_packing_buffer(packing_buffer_t *buf)
+{
+  if (buf->mmapped)
+    munmap(buf->ptr, buf->bytes);
+  else
+    free(buf->ptr);
+  buf->ptr = NULL;
+  buf->bytes = 0;
+}
 
-        /* Pack mc x kc tall thin column of A */
-        pack_A(mc, kc, &A[i*MC + l*KC*lda], lda, _A);
+static __thread packing_buffer_t packed_A = {NULL, 0, 0};
+static __thread packing_buffer_t packed_B = {NULL, 0, 0};
 
-        macro_kernel(mc, nc, kc, _A, _B, &C[i*MC + j*NC*ldc], ldc);
-      }
-    }
+/* Return a packing buffer of at least bytes bytes. The buffers are
+ * shared by all element types. */
+static void *get_packing_buffer(size_t bytes, const char *name,
+                                packing_buffer_t *buf)
+{
+  if (buf->bytes < bytes) {
+    if (buf->ptr)
+      free_packing_buffer(buf);
+    alloc_packing_buffer(bytes, name, buf);
   }
-  free(_A);
-  free(_B);
-  LIKWID_MARKER_STOP("OPTIMISED_GEMM");
+  return buf->ptr;
 }
+
+/*
+ * One instance of the skeleton per element type, each with its own
+ * micro kernel shape (see parameters.h).
+ */
+#define FLOAT double
+#define GEMM_NAME optimised_gemm
+#define GEMM_EPILOGUE_NAME optimised_gemm_epilogue
+#define GEMM_EPILOGUE_T gemm_epilogue_t
+#define GEMM_NT_NAME optimised_gemm_nt
+#define GEMM_SYRK_NAME optimised_syrk
+#define GEMM_FN(f) d_##f
+#define GEMM_MR MR
+#define GEMM_NR NR
+#define GEMM_CL CL_DOUBLES
+#define GEMM_MARKER "OPTIMISED_GEMM"
+#include "gemm-skeleton.c"
+#undef FLOAT
+#undef GEMM_NAME
+#undef GEMM_EPILOGUE_NAME
+#undef GEMM_EPILOGUE_T
+#undef GEMM_NT_NAME
+#undef GEMM_SYRK_NAME
+#undef GEMM_FN
+#undef GEMM_MR
+#undef GEMM_NR
+#undef GEMM_CL
+#undef GEMM_MARKER
+
+#define FLOAT float
+#define GEMM_NAME optimised_sgemm
+#define GEMM_EPILOGUE_NAME optimised_sgemm_epilogue
+#define GEMM_EPILOGUE_T sgemm_epilogue_t
+#define GEMM_FN(f) s_##f
+#define GEMM_MR SMR
+#define GEMM_NR SNR
+#define GEMM_CL (2*CL_DOUBLES)
+#define GEMM_MARKER "OPTIMISED_SGEMM"
+#include "gemm-skeleton.c"
+#undef FLOAT
+#undef GEMM_NAME
+#undef GEMM_EPILOGUE_NAME
+#undef GEMM_EPILOGUE_T
+#undef GEMM_NT_NAME
+#undef GEMM_SYRK_NAME
+#undef GEMM_FN
+#undef GEMM_MR
+#undef GEMM_NR
+#undef GEMM_CL
+#undef GEMM_MARKER
+
+#define FLOAT double complex
+#define GEMM_COMPLEX
+#define GEMM_REAL double
+#define GEMM_NAME optimised_zgemm
+#define GEMM_EPILOGUE_T void
+#define GEMM_FN(f) z_##f
+#define GEMM_MR ZMR
+#define GEMM_NR ZNR
+#define GEMM_CL (CL_DOUBLES/2)
+#define GEMM_MARKER "OPTIMISED_ZGEMM"
+#include "gemm-skeleton.c"
+#undef FLOAT
+#undef GEMM_COMPLEX
+#undef GEMM_REAL
+#undef GEMM_NAME
+#undef GEMM_EPILOGUE_NAME
+#undef GEMM_EPILOGUE_T
+#undef GEMM_NT_NAME
+#undef GEMM_SYRK_NAME
+#undef GEMM_FN
+#undef GEMM_MR
+#undef GEMM_NR
+#undef GEMM_CL
+#undef GEMM_MARKER
@@ -1,7 +1,37 @@
 #pragma once
 
+/*
+ * MC, KC, and NC are only the fallback values. At runtime they are
+ * derived from the cache hierarchy (see blocking.c), and can be
+ * overridden with the GEMM_MC, GEMM_KC, and GEMM_NC environment
+ * variables.
+ */
 #define MC 128          /* height of B block row */
 #define KC 256          /* Width of A block column */
 #define NC 1024         /* length of B block row */
+#ifndef MR
 #define MR 1            /* Rows of output matrix updated at once */
+#endif
+#ifndef NR
 #define NR 1            /* Columns of output matrix updated at once */
+#endif
+
+/* Micro kernel shapes for single precision and double complex. The
+ * same registers hold twice as many floats, and half as many complex
+ * numbers. For floats we go one step further, to two registers per
+ * column: with exactly one, gcc vectorises the micro kernel across
+ * columns instead of down them, and runs ten times slower. */
+#ifndef SMR
+#define SMR (4*MR)
+#endif
+#ifndef SNR
+#define SNR NR
+#endif
+#ifndef ZMR
+#define ZMR ((MR+1)/2)
+#endif
+#ifndef ZNR
+#define ZNR NR
+#endif
+
+#define CL_DOUBLES 8    /* Doubles per cache line */
@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <math.h>
+
+/*
+ * Strassen-Winograd recursion on top of optimised_gemm.
+ *
+ * Each level replaces 8 half-size products by 7, at the cost of 15
+ * additions of quarter-size matrices. Below a crossover size (set by
+ * STRASSEN_CROSSOVER, either at compile time or in the environment) we
+ * call optimised_gemm.
+ *
+ * With the quadrants of A, B, and C = A*B labelled 11, 21, 12, 22 the
+ * Winograd variant computes
+ *
+ *   S1 = A21 + A22   T1 = B12 - B11   P1 = A11 B11   P5 = S1 T1
+ *   S2 = S1 - A11    T2 = B22 - T1    P2 = A12 B21   P6 = S2 T2
+ *   S3 = A11 - A21   T3 = B22 - B12   P3 = S4 B22    P7 = S3 T3
+ *   S4 = A12 - S2    T4 = T2 - B21    P4 = A22 T4
+ *
+ *   U2 = P1 + P6  U3 = U2 + P7  U4 = U2 + P5
+ *   C11 = P1 + P2  C12 = U4 + P3  C21 = U3 - P4  C22 = U3 + P5
+ *
+ * The schedule below uses the quadrants of C as scratch space, and
+ * needs three temporaries per level: SA (m/2 x k/2), TB (k/2 x n/2),
+ * and P (m/2 x n/2). All temporaries live in one workspace, allocated
+ * up front, whose size is given by strassen_workspace_size().
+ */
+
+#include "likwidinc.h"
+
+#ifndef STRASSEN_CROSSOVER
+#define STRASSEN_CROSSOVER 1024
+#endif
+
+void optimised_gemm(int, int, int,
+                    const double *, int,
+                    const double *, int,
+                    double *, int);
+
+static int strassen_crossover(void)
+{
+  const char *env = getenv("STRASSEN_CROSSOVER");
+  if (env && atoi(env) > 0)
+    return atoi(env);
+  return STRASSEN_CROSSOVER;
+}
+
+/* Z = X + Y, all m x n */
+static void mat_add(int m, int n,
+                    const double *X, int ldx,
+                    const double *Y, int ldy,
+                    double *Z, int ldz)
+{
+  int i, j;
+  for (j = 0; j < n; j++)
+    for (i = 0; i < m; i++)
+      Z[j*ldz + i] = X[j*ldx + i] + Y[j*ldy + i];
+}
+
+/* Z = X - Y, all m x n */
+static void mat_sub(int m, int n,
+                    const double *X, int ldx,
+                    const double *Y, int ldy,
+                    double *Z, int ldz)
+{
+  int i, j;
+  for (j = 0; j < n; j++)
+    for (i = 0; i < m; i++)
+      Z[j*ldz + i] = X[j*ldx + i] - Y[j*ldy + i];
+}
+
+static void mat_zero(int m, int n, double *Z, int ldz)
+{
+  int i, j;
+  for (j = 0; j < n; j++)
+    for (i = 0; i < m; i++)
+      Z[j*ldz + i] = 0.0;
+}
+
+static int recurse(int m, int n, int k, int crossover)
+{
+  return m > crossover && n > crossover && k > crossover;
+}
+
+static size_t workspace_size(int m, int n, int k, int crossover)
+{
+  size_t m2 = m/2, n2 = n/2, k2 = k/2;
+  if (!recurse(m, n, k, crossover))
+    return 0;
+  return m2*k2 + k2*n2 + m2*n2 + workspace_size(m2, n2, k2, crossover);
+}
+
+/*
+ * Compute C = A*B (overwriting C).
+ * C has rank m x n, A has rank m x k, B has rank k x n.
+ * work must have room for workspace_size(m, n, k) doubles.
+ */
+static void winograd(int m, int n, int k,
+                     const double *A, int lda,
+                     const double *B, int ldb,
+                     double *C, int ldc,
+                     double *work, int crossover)
+{
+  int me, ne, ke, m2, n2, k2;
+  const double *A11, *A12, *A21, *A22;
+  const double *B11, *B12, *B21, *B22;
+  double *C11, *C12, *C21, *C22;
+  double *SA, *TB, *P, *next;
+
+  if (!recurse(m, n, k, crossover)) {
+    mat_zero(m, n, C, ldc);
+    optimised_gemm(m, n, k, A, lda, B, ldb, C, ldc);
+    return;
+  }
+
+  /* Recurse on the even sized part, odd rows/columns are peeled off
+   * and handled at the end. */
+  me = m & ~1;
+  ne = n & ~1;
+  ke = k & ~1;
+  m2 = me / 2;
+  n2 = ne / 2;
+  k2 = ke / 2;
+
+  A11 = A;
+  A21 = A + m2;
+  A12 = A + k2*lda;
+  A22 = A + m2 + k2*lda;
+  B11 = B;
+  B21 = B + k2;
+  B12 = B + n2*ldb;
+  B22 = B + k2 + n2*ldb;
+  C11 = C;
+  C21 = C + m2;
+  C12 = C + n2*ldc;
+  C22 = C + m2 + n2*ldc;
+
+  SA = work;
+  TB = SA + (size_t)m2*k2;
+  P = TB + (size_t)k2*n2;
+  next = P + (size_t)m2*n2;
+
+  mat_sub(m2, k2, A11, lda, A21, lda, SA, m2);           /* S3 */
+  mat_sub(k2, n2, B22, ldb, B12, ldb, TB, k2);           /* T3 */
+  winograd(m2, n2, k2, SA, m2, TB, k2, C21, ldc, next, crossover); /* P7 */
+
+  mat_add(m2, k2, A21, lda, A22, lda, SA, m2);           /* S1 */
+  mat_sub(k2, n2, B12, ldb, B11, ldb, TB, k2);           /* T1 */
+  winograd(m2, n2, k2, SA, m2, TB, k2, C22, ldc, next, crossover); /* P5 */
+
+  mat_sub(m2, k2, SA, m2, A11, lda, SA, m2);             /* S2 */
+  mat_sub(k2, n2, B22, ldb, TB, k2, TB, k2);             /* T2 */
+  winograd(m2, n2, k2, SA, m2, TB, k2, C12, ldc, next, crossover); /* P6 */
+
+  mat_sub(m2, k2, A12, lda, SA, m2, SA, m2);             /* S4 */
+  winograd(m2, n2, k2, SA, m2, B22, ldb, C11, ldc, next, crossover); /* P3 */
+
+  winograd(m2, n2, k2, A11, lda, B11, ldb, P, m2, next, crossover); /* P1 */
+
+  mat_add(m2, n2, P, m2, C12, ldc, C12, ldc);            /* U2 */
+  mat_add(m2, n2, C12, ldc, C21, ldc, C21, ldc);         /* U3 */
+  mat_add(m2, n2, C12, ldc, C22, ldc, C12, ldc);         /* U4 */
+  mat_add(m2, n2, C21, ldc, C22, ldc, C22, ldc);         /* C22 = U3 + P5 */
+  mat_add(m2, n2, C12, ldc, C11, ldc, C12, ldc);         /* C12 = U4 + P3 */
+
+  mat_sub(k2, n2, TB, k2, B21, ldb, TB, k2);             /* T4 */
+  winograd(m2, n2, k2, A22, lda, TB, k2, C11, ldc, next, crossover); /* P4 */
+  mat_sub(m2, n2, C21, ldc, C11, ldc, C21, ldc);         /* C21 = U3 - P4 */
+
+  winograd(m2, n2, k2, A12, lda, B21, ldb, C11, ldc, next, crossover); /* P2 */
+  mat_add(m2, n2, C11, ldc, P, m2, C11, ldc);            /* C11 = P1 + P2 */
+
+  /* Peeled rank-1 update from the last column of A / row of B */
+  if (ke < k)
+    optimised_gemm(me, ne, 1, A + ke*lda, lda, B + ke, ldb, C, ldc);
+  /* Last row of C */
+  if (me < m) {
+    mat_zero(1, n, C + me, ldc);
+    optimised_gemm(1, n, k, A + me, lda, B, ldb, C + me, ldc);
+  }
+  /* Last column of C */
+  if (ne < n) {
+    mat_zero(me, 1, C + ne*ldc, ldc);
+    optimised_gemm(me, 1, k, A, lda, B + ne*ldb, ldb, C + ne*ldc, ldc);
+  }
+}
+
+/*
+ * Number of doubles of workspace needed by strassen_gemm_ws for a
+ * problem of the given size.
+ */
+size_t strassen_workspace_size(int m, int n, int k)
+{
+  return (size_t)m*n + workspace_size(m, n, k, strassen_crossover());
+}
+
+/*
+ * Compute C = C + A*B with Strassen-Winograd.
+ * work must hold at least strassen_workspace_size(m, n, k) doubles.
+ */
+void strassen_gemm_ws(int m, int n, int k,
+                      const double *A, int lda,
+                      const double *B, int ldb,
+                      double *C, int ldc,
+                      double *work)
+{
+  int crossover = strassen_crossover();
+  double *AB = work;
+
+  LIKWID_MARKER_START("STRASSEN_GEMM");
+  if (!recurse(m, n, k, crossover)) {
+    optimised_gemm(m, n, k, A, lda, B, ldb, C, ldc);
+  } else {
+    winograd(m, n, k, A, lda, B, ldb, AB, m, work + (size_t)m*n, crossover);
+    mat_add(m, n, C, ldc, AB, m, C, ldc);
+  }
+  LIKWID_MARKER_STOP("STRASSEN_GEMM");
+}
+
+/*
+ * Compute C = C + A*B with Strassen-Winograd, allocating the
+ * workspace.
+ */
+void strassen_gemm(int m, int n, int k,
+                   const double *A, int lda,
+                   const double *B, int ldb,
+                   double *C, int ldc)
+{
+  double *work = NULL;
+  size_t size = strassen_workspace_size(m, n, k);
+  int err;
+
+  err = posix_memalign((void **)&work, 64, (size ? size : 1)*sizeof(*work));
+  if (err) {
+    fprintf(stderr, "posix_memalign for Strassen workspace failed: ");
+    switch (err) {
+    case EINVAL:
+      fprintf(stderr, "alignment is not a power of 2\n");
+      break;
+    case ENOMEM:
+      fprintf(stderr, "memory allocation error\n");
+      break;
+    default:
+      fprintf(stderr, "reason unknown\n");
+    }
+    exit(1);
+  }
+  strassen_gemm_ws(m, n, k, A, lda, B, ldb, C, ldc, work);
+  free(work);
+}
+
+/*
+ * How much larger the error of strassen_gemm can be than that of a
+ * classical gemm, whose error is bounded by k u |A||B|.
+ *
+ * For Winograd's variant with d levels of recursion down to n0 (Higham,
+ * Accuracy and Stability of Numerical Algorithms, sec. 23.2.2) the
+ * bound is [(k/n0)^log2(18) (n0^2 + 6 n0) - 6 k] u ||A|| ||B||.
+ */
+double strassen_error_factor(int m, int n, int k)
+{
+  int crossover = strassen_crossover();
+  int d = 0;
+  double n0, bound;
+  while (recurse(m, n, k, crossover)) {
+    m /= 2;
+    n /= 2;
+    k /= 2;
+    d++;
+  }
+  if (d == 0)
+    return 1;
+  n0 = k;
+  bound = pow(18.0, d) * (n0*n0 + 6*n0) - 6*n0*pow(2.0, d);
+  return fmax(1, bound / (n0*pow(2.0, d)));
+}
@@ -0,0 +1,333 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <mpi.h>
+
+#ifdef LIKWID_PERFMON
+#include <likwid.h>
+#else
+#define LIKWID_MARKER_START(a) do { (void)a; } while (0)
+#define LIKWID_MARKER_STOP(a) do { (void)a; } while (0)
+#define LIKWID_MARKER_INIT do { } while (0)
+#define LIKWID_MARKER_THREADINIT do { } while (0)
+#define LIKWID_MARKER_CLOSE do { } while (0)
+#define LIKWID_MARKER_REGISTER(a) do { (void)a; } while (0)
+#endif  /* LIKWID_PERFMON */
+
+#include "../common/bench.h"
+
+/*
+ * The NORMAL sweep of fivepoint.c, distributed with MPI.
+ *
+ * The grid is split over a 2D Cartesian grid of processes, in columns
+ * (the i index) and rows (the j index). Each process holds its block
+ * of the grid with a halo one point wide on each side, so no process
+ * ever holds the whole grid. Before each sweep the processes swap the
+ * edges of their blocks with their neighbours using non-blocking
+ * sends and receives. While those are in flight, each process updates
+ * the points of its block that don't read the halo, then waits, and
+ * finishes the edges.
+ *
+ * Compile with mpicc -O3 -march=native -o fivepoint-mpi fivepoint-mpi.c -lm
+ * and run with mpirun -np N ./fivepoint-mpi ...
+ *
+ *   STRONG rows cols: the grid is rows x cols in total
+ *   WEAK rows cols: each process has rows x cols of the grid
+ *   CHECK rows cols iterations: run iterations sweeps and compare
+ *     every block against the same sweeps on the whole grid, which
+ *     each process computes on its own (so keep the grid small)
+ */
+
+typedef enum MpiMode {STRONG, WEAK, CHECK} MpiMode;
+
+/* Local block: ni x nj owned points, plus the halo, ld = nj + 2 */
+#define lidx(i, j) ((i)*ld + (j))
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/* Global grid, for CHECK */
+#define idx(i, j) ((i)*rsize + (j))
+
+/* Tags for the halo messages, by the direction they travel */
+enum {TAG_DOWN_I, TAG_UP_I, TAG_DOWN_J, TAG_UP_J};
+
+/* Start and number of the points of n that part p of nparts owns */
+static void split(size_t n, int nparts, int p, size_t *start, size_t *count)
+{
+  const size_t base = n / nparts, rem = n % nparts;
+  *count = base + ((size_t)p < rem);
+  *start = p*base + ((size_t)p < rem ? (size_t)p : rem);
+}
+
+/*
+ * Update the points [ilo, ihi) x [jlo, jhi) of the local block, the
+ * same update as run_jacobi_normal in fivepoint.c.
+ */
+static void update_block(const double * restrict x_old, double * restrict x_new, size_t ld,
+                         size_t ilo, size_t ihi, size_t jlo, size_t jhi)
+{
+  size_t i, j;
+  for (i = ilo; i < ihi; i++) {
+    for (j = jlo; j < jhi; j++) {
+      x_new[lidx(i, j)] = 0.25*((x_old[lidx(i-1, j)] +
+                                 x_old[lidx(i+1, j)] +
+                                 x_old[lidx(i, j-1)] +
+                                 x_old[lidx(i, j+1)] -
+                                 4*x_old[lidx(i, j)]));
+    }
+  }
+}
+
+typedef struct Block {
+  MPI_Comm comm;
+  /* Neighbours below and above in i and in j (MPI_PROC_NULL at the
+   * edges of the grid) */
+  int down_i, up_i, down_j, up_j;
+  /* Owned points, and the global index of the first one */
+  size_t ni, nj, i0, j0;
+  /* Local range of points to update, skipping the global boundary */
+  size_t ulo_i, uhi_i, ulo_j, uhi_j;
+  /* One column of the block, for the halo in j */
+  MPI_Datatype column;
+} Block;
+
+/*
+ * Sweeps on the block, with the halo exchange overlapped with the
+ * update of the points that don't need it.
+ */
+static double run_jacobi_mpi(double * restrict x, double * restrict y, const Block *b, size_t maxiter)
+{
+  const size_t ld = b->nj + 2;
+  const size_t ni = b->ni, nj = b->nj;
+  /* [ai, bi) x [aj, bj) are the points that only read owned points */
+  const size_t ai = MAX(b->ulo_i, 2), bi = MAX(MIN(b->uhi_i, ni), ai);
+  const size_t aj = MAX(b->ulo_j, 2), bj = MAX(MIN(b->uhi_j, nj), aj);
+  double start, end;
+  size_t iter = 0;
+  double *x_old, *x_new;
+  MPI_Request req[8];
+
+  MPI_Barrier(b->comm);
+  start = MPI_Wtime();
+  LIKWID_MARKER_START("MPI");
+  while (iter < maxiter) {
+    if (iter%2) {
+      x_old = x;
+      x_new = y;
+    } else {
+      x_old = y;
+      x_new = x;
+    }
+    /* Owned columns 1 and ni are contiguous, owned rows 1 and nj are
+     * strided */
+    MPI_Irecv(&x_old[lidx(0, 1)], nj, MPI_DOUBLE, b->down_i, TAG_UP_I, b->comm, &req[0]);
+    MPI_Irecv(&x_old[lidx(ni + 1, 1)], nj, MPI_DOUBLE, b->up_i, TAG_DOWN_I, b->comm, &req[1]);
+    MPI_Irecv(&x_old[lidx(1, 0)], 1, b->column, b->down_j, TAG_UP_J, b->comm, &req[2]);
+    MPI_Irecv(&x_old[lidx(1, nj + 1)], 1, b->column, b->up_j, TAG_DOWN_J, b->comm, &req[3]);
+    MPI_Isend(&x_old[lidx(1, 1)], nj, MPI_DOUBLE, b->down_i, TAG_DOWN_I, b->comm, &req[4]);
+    MPI_Isend(&x_old[lidx(ni, 1)], nj, MPI_DOUBLE, b->up_i, TAG_UP_I, b->comm, &req[5]);
+    MPI_Isend(&x_old[lidx(1, 1)], 1, b->column, b->down_j, TAG_DOWN_J, b->comm, &req[6]);
+    MPI_Isend(&x_old[lidx(1, nj)], 1, b->column, b->up_j, TAG_UP_J, b->comm, &req[7]);
+
+    update_block(x_old, x_new, ld, ai, bi, aj, bj);
+    MPI_Waitall(8, req, MPI_STATUSES_IGNORE);
+
+    /* The edges: whole columns below and above, then the rest of the
+     * rows either side */
+    update_block(x_old, x_new, ld, b->ulo_i, MIN(ai, b->uhi_i), b->ulo_j, b->uhi_j);
+    update_block(x_old, x_new, ld, bi, b->uhi_i, b->ulo_j, b->uhi_j);
+    update_block(x_old, x_new, ld, ai, bi, b->ulo_j, MIN(aj, b->uhi_j));
+    update_block(x_old, x_new, ld, ai, bi, bj, b->uhi_j);
+    iter++;
+  }
+  LIKWID_MARKER_STOP("MPI");
+  end = MPI_Wtime();
+  return end - start;
+}
+
+/* The reference for CHECK: the same sweeps on the whole grid */
+static double *run_jacobi_serial(size_t rsize, size_t csize, size_t maxiter)
+{
+  double *x = malloc(rsize * csize * sizeof(*x));
+  double *y = malloc(rsize * csize * sizeof(*y));
+  double *x_old, *x_new;
+  size_t i, j, iter;
+
+  for (i = 0; i < csize; i++)
+    for (j = 0; j < rsize; j++)
+      x[idx(i, j)] = y[idx(i, j)] = (double)(i*j);
+  for (iter = 0; iter < maxiter; iter++) {
+    if (iter%2) {
+      x_old = x;
+      x_new = y;
+    } else {
+      x_old = y;
+      x_new = x;
+    }
+    for (i = 1; i < csize - 1; i++) {
+      for (j = 1; j < rsize - 1; j++) {
+        x_new[idx(i, j)] = 0.25*((x_old[idx(i-1, j)] +
+                                  x_old[idx(i+1, j)] +
+                                  x_old[idx(i, j-1)] +
+                                  x_old[idx(i, j+1)] -
+                                  4*x_old[idx(i, j)]));
+      }
+    }
+  }
+  free(x_new == x ? y : x);
+  return x_new;
+}
+
+typedef struct SweepArgs {
+  double *x, *y;
+  const Block *b;
+} SweepArgs;
+
+/*
+ * reps sweeps, timed by the slowest process. Every process gets the
+ * same time, so bench_run makes the same calibration on all of them.
+ */
+static double sweep_bench(void *ctx, size_t reps)
+{
+  SweepArgs *s = ctx;
+  double t = run_jacobi_mpi(s->x, s->y, s->b, reps), runtime;
+  MPI_Allreduce(&t, &runtime, 1, MPI_DOUBLE, MPI_MAX, s->b->comm);
+  return runtime;
+}
+
+int main(int argc, char **argv)
+{
+  size_t rsize, csize, ld, maxiter = 1, i, j;
+  double *x = NULL, *y = NULL;
+  double runtime = 0;
+  int rank, nprocs, dims[2] = {0, 0}, periods[2] = {0, 0}, coords[2];
+  MpiMode mode;
+  Block b;
+
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+  if (argc < 4 || argc > 5) {
+    if (rank == 0) {
+      printf("Usage: mpirun -np N %s <MODE> <rows> <cols> [<iterations>]\n", argv[0]);
+      printf("  Where MODE is one of STRONG, WEAK, or CHECK\n");
+      printf("  STRONG decomposes a rows x cols grid over the processes\n");
+      printf("  WEAK gives each process a rows x cols block\n");
+      printf("  CHECK runs iterations (default 10) sweeps and compares with\n");
+      printf("  the same sweeps on one process\n");
+    }
+    MPI_Finalize();
+    exit(EXIT_SUCCESS);
+  }
+  if (!strcmp(argv[1], "STRONG")) {
+    mode = STRONG;
+  } else if (!strcmp(argv[1], "WEAK")) {
+    mode = WEAK;
+  } else if (!strcmp(argv[1], "CHECK")) {
+    mode = CHECK;
+    maxiter = argc > 4 ? atoi(argv[4]) : 10;
+    if (maxiter < 1) {
+      if (rank == 0)
+        printf("Must run one or more iterations\n");
+      MPI_Finalize();
+      exit(EXIT_SUCCESS);
+    }
+  } else {
+    if (rank == 0)
+      printf("Unknown mode '%s', expecting one of STRONG, WEAK, or CHECK\n", argv[1]);
+    MPI_Finalize();
+    exit(EXIT_SUCCESS);
+  }
+  rsize = atoi(argv[2]);
+  csize = atoi(argv[3]);
+
+  MPI_Dims_create(nprocs, 2, dims);
+  if (mode == WEAK) {
+    csize *= dims[0];
+    rsize *= dims[1];
+  }
+  if (csize < (size_t)dims[0] || rsize < (size_t)dims[1]) {
+    if (rank == 0)
+      printf("Grid (%zu, %zu) too small for %d x %d processes\n", rsize, csize, dims[1], dims[0]);
+    MPI_Finalize();
+    exit(EXIT_SUCCESS);
+  }
+  MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 1, &b.comm);
+  MPI_Comm_rank(b.comm, &rank);
+  MPI_Cart_coords(b.comm, rank, 2, coords);
+  MPI_Cart_shift(b.comm, 0, 1, &b.down_i, &b.up_i);
+  MPI_Cart_shift(b.comm, 1, 1, &b.down_j, &b.up_j);
+  split(csize, dims[0], coords[0], &b.i0, &b.ni);
+  split(rsize, dims[1], coords[1], &b.j0, &b.nj);
+  /* Owned point k is local index k + 1. The first and last global
+   * columns and rows are fixed. */
+  b.ulo_i = b.i0 == 0 ? 2 : 1;
+  b.uhi_i = b.i0 + b.ni == csize ? b.ni : b.ni + 1;
+  b.ulo_j = b.j0 == 0 ? 2 : 1;
+  b.uhi_j = b.j0 + b.nj == rsize ? b.nj : b.nj + 1;
+  if (b.uhi_i < b.ulo_i)
+    b.uhi_i = b.ulo_i;
+  if (b.uhi_j < b.ulo_j)
+    b.uhi_j = b.ulo_j;
+
+  ld = b.nj + 2;
+  MPI_Type_vector(b.ni, 1, ld, MPI_DOUBLE, &b.column);
+  MPI_Type_commit(&b.column);
+
+  LIKWID_MARKER_INIT;
+  LIKWID_MARKER_THREADINIT;
+  LIKWID_MARKER_REGISTER("MPI");
+  x = malloc((b.ni + 2) * ld * sizeof(*x));
+  y = malloc((b.ni + 2) * ld * sizeof(*y));
+  /* The same initial grid as fivepoint.c, halo included (the halo on
+   * the edges of the grid is never read) */
+  for (i = 0; i < b.ni + 2; i++) {
+    for (j = 0; j < ld; j++) {
+      const double gi = (double)(b.i0 + i) - 1, gj = (double)(b.j0 + j) - 1;
+      x[lidx(i, j)] = y[lidx(i, j)] = gi*gj;
+    }
+  }
+
+  if (mode == CHECK) {
+    double *ref = run_jacobi_serial(rsize, csize, maxiter);
+    double *u = maxiter%2 ? x : y;
+    double error = 0, maxerror;
+    run_jacobi_mpi(x, y, &b, maxiter);
+    for (i = 1; i <= b.ni; i++)
+      for (j = 1; j <= b.nj; j++)
+        error = fmax(error, fabs(u[lidx(i, j)] - ref[idx(b.i0 + i - 1, b.j0 + j - 1)]));
+    MPI_Reduce(&error, &maxerror, 1, MPI_DOUBLE, MPI_MAX, 0, b.comm);
+    if (rank == 0)
+      printf("CHECK size: (%zu, %zu) processes: %d (%d x %d) iterations: %zu error: %g %s\n",
+             rsize, csize, nprocs, dims[1], dims[0], maxiter, maxerror,
+             maxerror == 0 ? "OK" : "FAILED");
+    free(ref);
+  } else {
+    SweepArgs args = {x, y, &b};
+    BenchResult result;
+    char params[128];
+    bench_run(sweep_bench, &args, &result);
+    runtime = result.median*result.reps;
+    if (rank == 0) {
+      printf("%s size: (%zu, %zu) processes: %d (%d x %d) time: %lf iterations: %zu MLUP/s: %lf MLUP/s/process: %lf\n",
+             mode == STRONG ? "STRONG" : "WEAK", rsize, csize, nprocs, dims[1], dims[0],
+             runtime, result.reps, 1e-6*(rsize-2)*(csize-2)/result.median,
+             1e-6*(rsize-2)*(csize-2)/result.median/nprocs);
+      snprintf(params, sizeof(params), "rows=%zu cols=%zu processes=%d (%d x %d)",
+               rsize, csize, nprocs, dims[1], dims[0]);
+      bench_report(mode == STRONG ? "fivepoint-mpi/STRONG" : "fivepoint-mpi/WEAK", params, &result,
+                   (double)(rsize-2)*(csize-2), "LUP");
+    }
+  }
+  free(x);
+  free(y);
+  MPI_Type_free(&b.column);
+  MPI_Comm_free(&b.comm);
+
+  LIKWID_MARKER_CLOSE;
+  MPI_Finalize();
+  return 0;
+}
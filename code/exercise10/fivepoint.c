@@ -6,6 +6,18 @@
 #include <limits.h>
 #include <float.h>
 #include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_get_max_threads() 1
+#endif
 
 #ifdef LIKWID_PERFMON
 #include <likwid.h>
@@ -18,99 +30,677 @@
 #define LIKWID_MARKER_REGISTER(a) do { (void)a; } while (0)
 #endif  /* LIKWID_PERFMON */
 
+#include "../common/bench.h"
+#include "../common/affinity.h"
+
 
-typedef enum LoopMode {NORMAL, TILED} LoopMode;
+typedef enum LoopMode {NORMAL, TILED, TEMPORAL, PADDED, SOLVE, REDBLACK} LoopMode;
 
 #define idx(i, j) ((i)*rsize + (j))
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/*
+ * The NORMAL and TILED sweeps come from stencil-kernel.c, once per
+ * stencil. Both are parallelised over columns (the i loop) with a
+ * static schedule, so each thread updates the same columns in every
+ * iteration, and, with the first touch initialisation in main, those
+ * columns live in memory local to the thread. The other modes are for
+ * the five-point stencil only.
+ */
+
+/* The update x_new = 0.25*(x(i-1, j) + ... - 4 x(i, j)). The weights
+ * are powers of two, so this rounds exactly as that expression does. */
+#define STENCIL_FN(f) fivepoint_##f
+#define STENCIL_RADIUS 1
+#define STENCIL_POINTS(P)                                       \
+  P(-1, 0, 0.25) P(1, 0, 0.25) P(0, -1, 0.25) P(0, 1, 0.25)     \
+  P(0, 0, -1.0)
+#include "stencil-kernel.c"
+#undef STENCIL_FN
+#undef STENCIL_RADIUS
+#undef STENCIL_POINTS
+
+/* The nine-point (compact, isotropic) Laplacian, scaled the same way */
+#define STENCIL_FN(f) ninepoint_##f
+#define STENCIL_RADIUS 1
+#define STENCIL_POINTS(P)                                               \
+  P(-1, -1, 0.05) P(-1, 0, 0.2) P(-1, 1, 0.05)                          \
+  P(0, -1, 0.2) P(0, 0, -1.0) P(0, 1, 0.2)                              \
+  P(1, -1, 0.05) P(1, 0, 0.2) P(1, 1, 0.05)
+#include "stencil-kernel.c"
+#undef STENCIL_FN
+#undef STENCIL_RADIUS
+#undef STENCIL_POINTS
+
+/* The fourth order, radius two, star Laplacian, scaled the same way */
+#define STENCIL_FN(f) radius2_##f
+#define STENCIL_RADIUS 2
+#define STENCIL_POINTS(P)                                               \
+  P(-2, 0, -1.0/60) P(-1, 0, 4.0/15) P(1, 0, 4.0/15) P(2, 0, -1.0/60)   \
+  P(0, -2, -1.0/60) P(0, -1, 4.0/15) P(0, 1, 4.0/15) P(0, 2, -1.0/60)   \
+  P(0, 0, -1.0)
+#include "stencil-kernel.c"
+#undef STENCIL_FN
+#undef STENCIL_RADIUS
+#undef STENCIL_POINTS
+
+/*
+ * An explicit step x_new = x + 0.25 div(a grad x), with the
+ * coefficient on each face the mean of the coefficients either side
+ * of it. For a = 1 every face weight is 0.25 and the centre weight,
+ * 1 minus the sum of the face weights, is 0, so this is the plain
+ * Jacobi average of the four neighbours (not the FIVEPOINT update
+ * above, whose centre weight is -1). For larger a the step grows with
+ * it and the centre weight goes negative, an over-relaxed step. Only
+ * at a = 2, the largest coefficient main sets up, does it reach the
+ * -1 of FIVEPOINT. It is here for the memory traffic of the
+ * coefficient grid, not as a solver.
+ */
+#define STENCIL_FN(f) varcoef_##f
+#define STENCIL_RADIUS 1
+#define FACE(di, dj) (0.125*(A(0, 0) + A(di, dj)))
+#define STENCIL_POINTS(P)                                               \
+  P(-1, 0, FACE(-1, 0)) P(1, 0, FACE(1, 0))                             \
+  P(0, -1, FACE(0, -1)) P(0, 1, FACE(0, 1))                             \
+  P(0, 0, 1 - FACE(-1, 0) - FACE(1, 0) - FACE(0, -1) - FACE(0, 1))
+#include "stencil-kernel.c"
+#undef STENCIL_FN
+#undef STENCIL_RADIUS
+#undef STENCIL_POINTS
+#undef FACE
+
+typedef double (*normal_fn_t)(double *, double *, const double *, size_t, size_t, size_t);
+typedef double (*tiled_fn_t)(double *, double *, const double *, size_t, size_t, size_t, size_t);
+
+/* The stencils for NORMAL and TILED, selected with STENCIL in the
+ * environment. To add a stencil, define it above and add it here. */
+static const struct {
+  const char *name;
+  size_t radius;
+  int coefficients;
+  normal_fn_t normal;
+  tiled_fn_t tiled;
+} stencils[] = {
+  {"FIVEPOINT", 1, 0, fivepoint_normal, fivepoint_tiled},
+  {"NINEPOINT", 1, 0, ninepoint_normal, ninepoint_tiled},
+  {"RADIUS2", 2, 0, radius2_normal, radius2_tiled},
+  {"VARCOEF", 1, 1, varcoef_normal, varcoef_tiled},
+};
 
-static double timestamp()
+#define NSTENCILS (sizeof(stencils)/sizeof(stencils[0]))
+
+/*
+ * Temporal blocking with a wavefront over columns (the i index). Both
+ * of the sweeps above still stream the whole grid through the cache
+ * once per iteration. Here we advance depth iterations on a block of
+ * blocksize columns before moving on, so that for small enough blocks
+ * those iterations run out of cache.
+ *
+ * To update columns [lo, hi) to iteration t+1 we need columns
+ * [lo-1, hi+1) at iteration t, so within a block, iteration t covers
+ * the columns shifted down by t:
+ *
+ *   [lo - t, lo + blocksize - t)
+ *
+ * Columns below lo - t were brought to iteration t by the previous
+ * block, columns above are still at iteration t-1 (or t, for the one
+ * we need). With only two grids, iteration t+1 overwrites iteration
+ * t-1, but the previous block has only written iteration t+1 below
+ * lo - t - 1, and we only need iteration t-1 from lo - t - 1 upwards,
+ * so nothing we still need is overwritten.
+ *
+ * The columns of each (block, iteration) are shared out between the
+ * threads, which share the cache the block lives in. Choose blocksize
+ * so that 2 * (blocksize + depth) columns of doubles fit in it.
+ */
+static double run_jacobi_temporal(double * restrict x, double * restrict y, size_t rsize, size_t csize, size_t blocksize, size_t depth, size_t maxiter)
 {
-  struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  return (double)ts.tv_sec + (double)ts.tv_nsec * 1.e-9;
+  double start, end;
+
+  start = bench_timestamp();
+#pragma omp parallel
+  {
+    size_t t, iter = 0;
+    long i, lo;
+    double *x_old, *x_new;
+
+    LIKWID_MARKER_START("TEMPORAL");
+    while (iter < maxiter) {
+      const size_t steps = MIN(depth, maxiter - iter);
+      /* The last blocks only finish off the top columns of the later
+       * iterations */
+      for (lo = 1; lo < (long)(csize + steps) - 2; lo += blocksize) {
+        for (t = 0; t < steps; t++) {
+          const long ilo = MAX(1, lo - (long)t);
+          const long ihi = MIN(lo + (long)blocksize - (long)t, (long)csize - 1);
+          if ((iter + t)%2) {
+            x_old = x;
+            x_new = y;
+          } else {
+            x_old = y;
+            x_new = x;
+          }
+#pragma omp for schedule(static)
+          for (i = ilo; i < ihi; i++)
+            fivepoint_update(x_old, x_new, NULL, rsize, i, 1, rsize - 1);
+        }
+      }
+      iter += steps;
+    }
+    LIKWID_MARKER_STOP("TEMPORAL");
+  }
+  end = bench_timestamp();
+  return end - start;
 }
 
-static double run_jacobi_normal(double * restrict x, double * restrict y, size_t rsize, size_t csize, size_t maxiter)
+/*
+ * Row stride, in doubles, of the grids for the PADDED mode. Each
+ * column (contiguous run of rsize doubles) starts on a 64 byte
+ * boundary, and we avoid strides that are a multiple of 4KB: with
+ * those, the same j in neighbouring columns maps to the same L1 cache
+ * set, and the three columns the stencil reads fight over the ways.
+ */
+static size_t padded_size(size_t rsize)
+{
+  size_t ld = (rsize + 7) & ~(size_t)7;
+  if ((ld * sizeof(double)) % 4096 == 0)
+    ld += 8;
+  return ld;
+}
+
+#if defined(__AVX512F__)
+#define VEC_WIDTH 8
+#define vec_t __m512d
+#define vec_load _mm512_load_pd
+#define vec_loadu _mm512_loadu_pd
+#define vec_store _mm512_store_pd
+#define vec_add _mm512_add_pd
+#define vec_sub _mm512_sub_pd
+#define vec_mul _mm512_mul_pd
+#define vec_set1 _mm512_set1_pd
+#elif defined(__AVX2__)
+#define VEC_WIDTH 4
+#define vec_t __m256d
+#define vec_load _mm256_load_pd
+#define vec_loadu _mm256_loadu_pd
+#define vec_store _mm256_store_pd
+#define vec_add _mm256_add_pd
+#define vec_sub _mm256_sub_pd
+#define vec_mul _mm256_mul_pd
+#define vec_set1 _mm256_set1_pd
+#endif
+
+/*
+ * Update one column: out[j] from the columns left, mid, and right of
+ * it, for 1 <= j < rsize - 1. All four are 64 byte aligned. The first
+ * few j are done one at a time, so the vector loop starts at j =
+ * VEC_WIDTH, where the loads from left, right, and mid, and the store,
+ * are aligned. Only mid[j-1] and mid[j+1] are unaligned.
+ * The arithmetic is the same as in the other kernels, so the results
+ * are identical. Without AVX2 we leave vectorisation to the compiler.
+ */
+static inline void update_column(const double * restrict left,
+                                 const double * restrict mid,
+                                 const double * restrict right,
+                                 double * restrict out, size_t rsize)
+{
+  size_t j;
+#ifdef VEC_WIDTH
+  const vec_t four = vec_set1(4.0);
+  const vec_t quarter = vec_set1(0.25);
+  for (j = 1; j < MIN(VEC_WIDTH, rsize - 1); j++)
+    out[j] = 0.25*((left[j] + right[j] + mid[j-1] + mid[j+1] - 4*mid[j]));
+  for (; j + VEC_WIDTH <= rsize - 1; j += VEC_WIDTH) {
+    vec_t sum = vec_add(vec_add(vec_add(vec_load(left + j), vec_load(right + j)),
+                                vec_loadu(mid + j - 1)),
+                        vec_loadu(mid + j + 1));
+    vec_store(out + j, vec_mul(quarter, vec_sub(sum, vec_mul(four, vec_load(mid + j)))));
+  }
+  for (; j < rsize - 1; j++)
+    out[j] = 0.25*((left[j] + right[j] + mid[j-1] + mid[j+1] - 4*mid[j]));
+#else
+#pragma omp simd
+  for (j = 1; j < rsize - 1; j++)
+    out[j] = 0.25*((left[j] + right[j] + mid[j-1] + mid[j+1] - 4*mid[j]));
+#endif
+}
+
+/*
+ * As the NORMAL sweep, but on grids with padded, aligned columns of
+ * ld doubles, and with an explicitly vectorised (AVX-512 or AVX2,
+ * whichever we are compiled for) inner loop.
+ */
+static double run_jacobi_padded(double * restrict x, double * restrict y, size_t rsize, size_t ld, size_t csize, size_t maxiter)
 {
-  size_t i, j, iter = 0;
-  double *x_old, *x_new;
   double start, end;
 
-  LIKWID_MARKER_START("UNTILED");
-  start = timestamp();
-  while (iter < maxiter) {
-    if (iter%2) {
-      x_old = x;
-      x_new = y;
-    } else {
-      x_old = y;
-      x_new = x;
-    }
-    for (i = 1; i < csize - 1; i++) {
-      for (j = 1; j < rsize - 1; j++) {
-        x_new[idx(i, j)] = 0.25*((x_old[idx(i-1, j)] +
-                                  x_old[idx(i+1, j)] +
-                                  x_old[idx(i, j-1)] +
-                                  x_old[idx(i, j+1)] -
-                                  4*x_old[idx(i, j)]));
+  start = bench_timestamp();
+#pragma omp parallel
+  {
+    size_t i, iter = 0;
+    double *x_old, *x_new;
+
+    LIKWID_MARKER_START("PADDED");
+    while (iter < maxiter) {
+      if (iter%2) {
+        x_old = x;
+        x_new = y;
+      } else {
+        x_old = y;
+        x_new = x;
       }
+#pragma omp for schedule(static)
+      for (i = 1; i < csize - 1; i++)
+        update_column(&x_old[(i-1)*ld], &x_old[i*ld], &x_old[(i+1)*ld],
+                      &x_new[i*ld], rsize);
+      iter++;
     }
-    iter++;
+    LIKWID_MARKER_STOP("PADDED");
   }
-  end = timestamp();
-
-  LIKWID_MARKER_STOP("UNTILED");
+  end = bench_timestamp();
   return end - start;
 }
 
-static double run_jacobi_tiled(double * restrict x, double * restrict y, size_t rsize, size_t csize, size_t blocksize, size_t maxiter)
+/*
+ * Snapshots of the grid for SOLVE. If SNAPSHOT_EVERY is set in the
+ * environment, every that many iterations the grid is written, as the
+ * raw values (of the storage type) in memory order, to
+ * SNAPSHOT_DIR/fivepoint-<iteration>.dat
+ * (SNAPSHOT_DIR defaults to the current directory).
+ *
+ * The solver copies the grid into a page aligned buffer and hands it
+ * to a writer thread, which writes it with O_DIRECT, straight to the
+ * device rather than through the page cache, while the solver carries
+ * on. The solver only stalls if the previous snapshot is still being
+ * written when the next one is due. The copy costs about one sweep.
+ *
+ * The writer may run on any of the CPUs the process started with.
+ * Threads inherit the affinity of the thread that creates them, which
+ * after pin_threads is the one CPU of OpenMP thread 0, and a writer
+ * sharing that would hold up every barrier of the solver.
+ */
+#define SNAPSHOT_ALIGN 4096
+
+typedef struct Snapshot {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  const char *dir;
+  char *buffer;
+  /* Size of the grid, and of the buffer, rounded up for O_DIRECT */
+  size_t bytes, padded;
+  size_t every, iteration, count;
+  /* full: the buffer holds a snapshot to write, done: no more to come */
+  int full, done;
+  /* Time the writer spent writing, and the solver spent copying and
+   * waiting for the writer */
+  double write_time, copy_time, wait_time, copy_start;
+} Snapshot;
+
+static void snapshot_write(const Snapshot *snap, size_t iteration)
+{
+  char path[PATH_MAX];
+  size_t written = 0;
+  int fd;
+
+  snprintf(path, sizeof(path), "%s/fivepoint-%zu.dat", snap->dir, iteration);
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+  /* File systems without O_DIRECT (tmpfs) refuse it */
+  if (fd < 0 && errno == EINVAL)
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(path);
+    return;
+  }
+  while (written < snap->padded) {
+    const ssize_t n = write(fd, (char *)snap->buffer + written, snap->padded - written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      perror(path);
+      break;
+    }
+    written += n;
+  }
+  /* Drop the padding */
+  if (ftruncate(fd, snap->bytes))
+    perror(path);
+  close(fd);
+}
+
+static void *snapshot_writer(void *arg)
+{
+  Snapshot *snap = arg;
+
+  pthread_mutex_lock(&snap->lock);
+  for (;;) {
+    size_t iteration;
+    double start;
+
+    while (!snap->full && !snap->done)
+      pthread_cond_wait(&snap->cond, &snap->lock);
+    if (!snap->full)
+      break;
+    iteration = snap->iteration;
+    pthread_mutex_unlock(&snap->lock);
+    start = bench_timestamp();
+    snapshot_write(snap, iteration);
+    pthread_mutex_lock(&snap->lock);
+    snap->write_time += bench_timestamp() - start;
+    snap->count++;
+    snap->full = 0;
+    pthread_cond_broadcast(&snap->cond);
+  }
+  pthread_mutex_unlock(&snap->lock);
+  return NULL;
+}
+
+/*
+ * Start the writer thread, on the CPUs cpus, for snapshots of a grid
+ * of bytes bytes, or return NULL if SNAPSHOT_EVERY is not set.
+ */
+static Snapshot *snapshot_start(size_t bytes, const cpu_set_t *cpus)
 {
-  size_t i, jb, j, iter = 0;
-  double *x_old, *x_new;
+  const char *every = getenv("SNAPSHOT_EVERY");
+  const char *dir = getenv("SNAPSHOT_DIR");
+  pthread_attr_t attr;
+  Snapshot *snap;
+
+  if (!every || atol(every) < 1)
+    return NULL;
+  snap = calloc(1, sizeof(*snap));
+  snap->every = atol(every);
+  snap->dir = dir ? dir : ".";
+  snap->bytes = bytes;
+  snap->padded = (bytes + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+  if (posix_memalign((void **)&snap->buffer, SNAPSHOT_ALIGN, snap->padded)) {
+    printf("Unable to allocate snapshot buffer\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(snap->buffer, 0, snap->padded);
+  pthread_mutex_init(&snap->lock, NULL);
+  pthread_cond_init(&snap->cond, NULL);
+  pthread_attr_init(&attr);
+  if (pthread_attr_setaffinity_np(&attr, sizeof(*cpus), cpus))
+    printf("Unable to set the CPUs of the snapshot writer\n");
+  if (pthread_create(&snap->thread, &attr, snapshot_writer, snap)) {
+    printf("Unable to start snapshot writer\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_attr_destroy(&attr);
+  return snap;
+}
+
+/* Wait until the writer has finished with the buffer */
+static void snapshot_wait(Snapshot *snap)
+{
+  const double start = bench_timestamp();
+
+  pthread_mutex_lock(&snap->lock);
+  while (snap->full)
+    pthread_cond_wait(&snap->cond, &snap->lock);
+  pthread_mutex_unlock(&snap->lock);
+  snap->wait_time += bench_timestamp() - start;
+}
+
+/* Hand the buffer, holding iteration iteration, to the writer */
+static void snapshot_post(Snapshot *snap, size_t iteration)
+{
+  pthread_mutex_lock(&snap->lock);
+  snap->iteration = iteration;
+  snap->full = 1;
+  pthread_cond_broadcast(&snap->cond);
+  pthread_mutex_unlock(&snap->lock);
+}
+
+/* Write out the last snapshot and stop the writer */
+static void snapshot_finish(Snapshot *snap)
+{
+  pthread_mutex_lock(&snap->lock);
+  snap->done = 1;
+  pthread_cond_broadcast(&snap->cond);
+  pthread_mutex_unlock(&snap->lock);
+  pthread_join(snap->thread, NULL);
+  pthread_cond_destroy(&snap->cond);
+  pthread_mutex_destroy(&snap->lock);
+  free(snap->buffer);
+}
+
+/* Give up on SOLVE after this many iterations */
+#define SOLVE_MAXITER 100000000
+
+/* or if the residual hasn't reached a new low in this many */
+#define SOLVE_STALL 1000
+
+#define STORAGE double
+#define ACCUM double
+#define SOLVE_FN(f) double_##f
+#include "solve-kernel.c"
+#undef STORAGE
+#undef ACCUM
+#undef SOLVE_FN
+
+#define STORAGE float
+#define ACCUM float
+#define SOLVE_FN(f) float_##f
+#include "solve-kernel.c"
+#undef STORAGE
+#undef ACCUM
+#undef SOLVE_FN
+
+/* Float grids, updated in double */
+#define STORAGE float
+#define ACCUM double
+#define SOLVE_FN(f) float_double_##f
+#include "solve-kernel.c"
+#undef STORAGE
+#undef ACCUM
+#undef SOLVE_FN
+
+/* The storage types for SOLVE */
+static const struct {
+  const char *name;
+  size_t size;
+  void (*init)(void *, void *, size_t, size_t);
+  double (*solve)(void *, void *, size_t, size_t, double, size_t, Snapshot *, size_t *, double *, void **);
+  double (*error)(const void *, size_t, size_t);
+} storages[] = {
+  {"DOUBLE", sizeof(double), double_init, double_run_jacobi_solve, double_error},
+  {"FLOAT", sizeof(float), float_init, float_run_jacobi_solve, float_error},
+  {"FLOAT_DOUBLE", sizeof(float), float_double_init, float_double_run_jacobi_solve, float_double_error},
+};
+
+#define NSTORAGES (sizeof(storages)/sizeof(storages[0]))
+
+/*
+ * Red-black layout for REDBLACK. Point (i, j) is red if i + j is even,
+ * black otherwise. Each column is stored as its even j entries, then
+ * its odd j entries, h = (rsize + 1)/2 apart. The neighbours (i-1, j)
+ * and (i+1, j) of a point have the same parity of j, and (i, j-1) and
+ * (i, j+1) the other one, so all four are at unit stride from the
+ * point in the other colour, and a half sweep is a contiguous,
+ * vectorisable loop instead of a stride two one.
+ */
+#define rb_idx(i, j) ((i)*2*h + ((j)%2)*h + (j)/2)
+
+/*
+ * Update the points of colour (0 red, 1 black) in interior column i of
+ * u with SOR, u += omega*0.25*r, and return the sum of r^2, where r is
+ * the residual before the update. With omega = 0, only compute the
+ * residual.
+ */
+static double redblack_column(double * restrict u, size_t rsize, size_t h, size_t i, int colour, double omega)
+{
+  /* Points of this colour have j = 2m + p, the half of the column we
+   * update, their (i, j-1) and (i, j+1) neighbours are at m - 1 + p and
+   * m + p in the other half */
+  const long p = (i + colour) % 2;
+  const double * restrict left = &u[(i-1)*2*h + p*h];
+  const double * restrict right = &u[(i+1)*2*h + p*h];
+  const double * restrict other = &u[i*2*h + (1-p)*h];
+  double * restrict mid = &u[i*2*h + p*h];
+  const long lo = 1 - p;
+  const long hi = ((long)rsize - 2 - p)/2 + 1;
+  double norm2 = 0;
+  long m;
+
+  if (rsize < 3)
+    return 0;
+  if (omega == 0) {
+#pragma omp simd reduction(+:norm2)
+    for (m = lo; m < hi; m++) {
+      const double r = left[m] + right[m] + other[m - 1 + p] + other[m + p] - 4*mid[m];
+      norm2 += r*r;
+    }
+  } else {
+#pragma omp simd reduction(+:norm2)
+    for (m = lo; m < hi; m++) {
+      const double r = left[m] + right[m] + other[m - 1 + p] + other[m + p] - 4*mid[m];
+      mid[m] += omega*0.25*r;
+      norm2 += r*r;
+    }
+  }
+  return norm2;
+}
+
+/*
+ * Solve the same problem as SOLVE with red-black Gauss-Seidel
+ * (omega = 1) or SOR (1 < omega < 2), in place on the single grid u in
+ * red-black layout. A sweep updates all the red points, which only
+ * read black ones, then all the black points, which read the new red
+ * ones. So each half sweep is a parallel loop over the columns, and a
+ * sweep reads and writes one grid where Jacobi reads one and writes
+ * another.
+ *
+ * The residual norm is fused into the sweep as in SOLVE, but since the
+ * black residuals are taken after the red update, it is not quite the
+ * residual of either iterate. When it first drops below the tolerance
+ * we check the true residual in a separate pass, and carry on if that
+ * is still too large. The initial residual is computed the same way.
+ *
+ * Sets *iterations to the number of sweeps, and *residual to the last
+ * relative residual. Returns the time to solution.
+ */
+static double run_redblack_solve(double * restrict u, size_t rsize, size_t csize, double tol, double omega,
+                                 size_t *iterations, double *residual)
+{
+  const size_t h = (rsize + 1)/2;
   double start, end;
-  LIKWID_MARKER_START("TILED");
+  double rnorm2 = 0, r0norm2 = 0;
+  size_t niter = 0;
 
-  start = timestamp();
-  while (iter < maxiter) {
-    if (iter%2) {
-      x_old = x;
-      x_new = y;
-    } else {
-      x_old = y;
-      x_new = x;
-    }
-    for (jb = 1; jb < rsize - 1; jb += blocksize) {
-      for (i = 1; i < csize - 1; i++) {
-        for (j = jb; j < MIN(jb + blocksize, rsize - 1); j++) {
-          x_new[idx(i, j)] = 0.25*((x_old[idx(i-1, j)] +
-                                    x_old[idx(i+1, j)] +
-                                    x_old[idx(i, j-1)] +
-                                    x_old[idx(i, j+1)] -
-                                    4*x_old[idx(i, j)]));
-        }
+  start = bench_timestamp();
+#pragma omp parallel
+  {
+    size_t i, iter = 0;
+    int colour, converged = 0;
+    double r2;
+
+    LIKWID_MARKER_START("REDBLACK");
+#pragma omp for schedule(static) reduction(+:r0norm2)
+    for (i = 1; i < csize - 1; i++)
+      r0norm2 += (redblack_column(u, rsize, h, i, 0, 0) +
+                  redblack_column(u, rsize, h, i, 1, 0));
+    while (!converged && iter < SOLVE_MAXITER) {
+#pragma omp single
+      rnorm2 = 0;
+      for (colour = 0; colour < 2; colour++) {
+#pragma omp for schedule(static) reduction(+:rnorm2)
+        for (i = 1; i < csize - 1; i++)
+          rnorm2 += redblack_column(u, rsize, h, i, colour, omega);
+      }
+      r2 = rnorm2;
+      /* Everyone has read rnorm2 before anyone resets it */
+#pragma omp barrier
+      iter++;
+      if (r2 <= tol*tol*r0norm2) {
+#pragma omp single
+        rnorm2 = 0;
+#pragma omp for schedule(static) reduction(+:rnorm2)
+        for (i = 1; i < csize - 1; i++)
+          rnorm2 += (redblack_column(u, rsize, h, i, 0, 0) +
+                     redblack_column(u, rsize, h, i, 1, 0));
+        r2 = rnorm2;
+#pragma omp barrier
+        converged = r2 <= tol*tol*r0norm2;
       }
     }
-    iter++;
+    LIKWID_MARKER_STOP("REDBLACK");
+#pragma omp single
+    niter = iter;
   }
-  end = timestamp();
-  LIKWID_MARKER_STOP("TILED");
+  end = bench_timestamp();
+  *iterations = niter;
+  *residual = r0norm2 > 0 ? sqrt(rnorm2 / r0norm2) : 0;
   return end - start;
 }
 
+typedef struct SweepArgs {
+  LoopMode mode;
+  size_t stencil;
+  double *x, *y;
+  const double *a;
+  size_t rsize, csize, ld, blocksize, depth;
+} SweepArgs;
+
+/* reps iterations of the NORMAL, TILED, TEMPORAL, or PADDED sweep */
+static double sweep_bench(void *ctx, size_t reps)
+{
+  SweepArgs *s = ctx;
+  switch (s->mode) {
+  case NORMAL:
+    return stencils[s->stencil].normal(s->x, s->y, s->a, s->rsize, s->csize, reps);
+  case TILED:
+    return stencils[s->stencil].tiled(s->x, s->y, s->a, s->rsize, s->csize, s->blocksize, reps);
+  case TEMPORAL:
+    return run_jacobi_temporal(s->x, s->y, s->rsize, s->csize, s->blocksize, s->depth, reps);
+  case PADDED:
+    return run_jacobi_padded(s->x, s->y, s->rsize, s->ld, s->csize, reps);
+  case SOLVE:
+  case REDBLACK:
+    break;
+  }
+  return 0;
+}
+
 int main(int argc, char **argv)
 {
-  size_t rsize, csize, blocksize, maxiter = 1, i, j;
-  double *x = NULL, *y = NULL;
+  size_t rsize, csize, ld, blocksize = 0, depth = 0, check_every = 1, storage = 0, stencil = 0, r, i, j;
+  const char *stencil_name = getenv("STENCIL");
+  cpu_set_t process_cpus;
+  double *x = NULL, *y = NULL, *a = NULL;
+  double tol = 0, omega = 1;
   double runtime = 0;
+  BenchResult result;
+  char params[160];
   
   LoopMode mode;
 
-  if ( argc < 4 || argc > 5) {
-    printf("Usage: %s <MODE> <rows> <cols> [<tile size>]\n", argv[0]);
-    printf("  Where MODE is one of NORMAL or TILED\n");
+  if ( argc < 4 || argc > 7) {
+    printf("Usage: %s <MODE> <rows> <cols> [<tile size> [<depth>]]\n", argv[0]);
+    printf("       %s SOLVE <rows> <cols> <tolerance> [<check every> [<storage>]]\n", argv[0]);
+    printf("       %s REDBLACK <rows> <cols> <tolerance> [<omega>]\n", argv[0]);
+    printf("  Where MODE is one of NORMAL, TILED, TEMPORAL, or PADDED\n");
     printf("  If MODE is TILED then a tile size must be specified\n");
+    printf("  If MODE is TEMPORAL then a tile size (in columns) and a depth\n");
+    printf("  (iterations per tile) must be specified\n");
+    printf("  SOLVE iterates until the residual drops by a factor tolerance,\n");
+    printf("  checking every 1 (default) or more iterations, with grids of\n");
+    printf("  storage one of");
+    for (i = 0; i < NSTORAGES; i++)
+      printf(" %s%s", storages[i].name, i ? "" : " (default)");
+    printf("\n");
+    printf("  SOLVE writes a snapshot of the grid every SNAPSHOT_EVERY\n");
+    printf("  iterations to SNAPSHOT_DIR, if set in the environment\n");
+    printf("  REDBLACK does the same with red-black Gauss-Seidel, or SOR if\n");
+    printf("  omega (default 1) is between 1 and 2\n");
+    printf("  NORMAL and TILED sweep the stencil STENCIL from the environment,\n");
+    printf("  one of");
+    for (i = 0; i < NSTENCILS; i++)
+      printf(" %s%s", stencils[i].name, i ? "" : " (default)");
+    printf("\n");
     exit(EXIT_SUCCESS);
   } else {
     rsize = atoi(argv[2]);
@@ -122,52 +712,234 @@ int main(int argc, char **argv)
       }
       blocksize = atoi(argv[4]);
       mode = TILED;
+    } else if (!strcmp(argv[1], "TEMPORAL")) {
+      if (argc != 6) {
+        printf("Must provide tile size and depth when selecting TEMPORAL mode\n");
+        exit(EXIT_SUCCESS);
+      }
+      blocksize = atoi(argv[4]);
+      depth = atoi(argv[5]);
+      if (blocksize < 1 || depth < 1) {
+        printf("Tile size and depth must be positive\n");
+        exit(EXIT_SUCCESS);
+      }
+      mode = TEMPORAL;
     } else if(!strcmp(argv[1], "NORMAL")) {
       mode = NORMAL;
+    } else if(!strcmp(argv[1], "PADDED")) {
+      mode = PADDED;
+    } else if(!strcmp(argv[1], "SOLVE")) {
+      if (argc < 5) {
+        printf("Must provide tolerance when selecting SOLVE mode\n");
+        exit(EXIT_SUCCESS);
+      }
+      tol = atof(argv[4]);
+      check_every = argc > 5 ? atoi(argv[5]) : 1;
+      if (check_every < 1) {
+        printf("Must check the residual every one or more iterations\n");
+        exit(EXIT_SUCCESS);
+      }
+      if (argc > 6) {
+        for (storage = 0; storage < NSTORAGES; storage++)
+          if (!strcmp(argv[6], storages[storage].name))
+            break;
+        if (storage == NSTORAGES) {
+          printf("Unknown storage '%s'\n", argv[6]);
+          exit(EXIT_SUCCESS);
+        }
+      }
+      mode = SOLVE;
+    } else if(!strcmp(argv[1], "REDBLACK")) {
+      if (argc < 5) {
+        printf("Must provide tolerance when selecting REDBLACK mode\n");
+        exit(EXIT_SUCCESS);
+      }
+      tol = atof(argv[4]);
+      omega = argc > 5 ? atof(argv[5]) : 1;
+      if (omega <= 0 || omega >= 2) {
+        printf("omega must be between 0 and 2\n");
+        exit(EXIT_SUCCESS);
+      }
+      mode = REDBLACK;
     } else {
-      printf("Unknown loop mode '%s', expecting one of NORMAL or TILED\n", argv[1]);
+      printf("Unknown loop mode '%s', expecting one of NORMAL, TILED, TEMPORAL, PADDED, SOLVE, or REDBLACK\n", argv[1]);
+      exit(EXIT_SUCCESS);
+    }
+    if (stencil_name && *stencil_name) {
+      for (stencil = 0; stencil < NSTENCILS; stencil++)
+        if (!strcmp(stencil_name, stencils[stencil].name))
+          break;
+      if (stencil == NSTENCILS) {
+        printf("Unknown stencil '%s'\n", stencil_name);
+        exit(EXIT_SUCCESS);
+      }
+      if (stencil && mode != NORMAL && mode != TILED) {
+        printf("Only NORMAL and TILED modes sweep stencil '%s'\n", stencil_name);
+        exit(EXIT_SUCCESS);
+      }
+    }
+    r = stencils[stencil].radius;
+    if (rsize < 2*r + 1 || csize < 2*r + 1) {
+      printf("Grid must be at least %zu points in each direction\n", 2*r + 1);
       exit(EXIT_SUCCESS);
     }
   }
 
+  /* The CPUs we started with, for the snapshot writer, before any
+   * pinning */
+  if (sched_getaffinity(0, sizeof(process_cpus), &process_cpus)) {
+    perror("sched_getaffinity");
+    exit(EXIT_FAILURE);
+  }
   LIKWID_MARKER_INIT;
+#pragma omp parallel
   LIKWID_MARKER_THREADINIT;
   LIKWID_MARKER_REGISTER("TILED");
   LIKWID_MARKER_REGISTER("UNTILED");
-  x = malloc(rsize * csize * sizeof(*x));
-  y = malloc(rsize * csize * sizeof(*y));
-  for(i=0; i < csize; i++) {
+  LIKWID_MARKER_REGISTER("TEMPORAL");
+  LIKWID_MARKER_REGISTER("PADDED");
+  LIKWID_MARKER_REGISTER("SOLVE");
+  LIKWID_MARKER_REGISTER("REDBLACK");
+  pin_threads();
+  if (mode == REDBLACK) {
+    /* One grid, in red-black layout */
+    const size_t h = (rsize + 1)/2;
+    ld = 2*h;
+    x = malloc(ld * csize * sizeof(*x));
+#pragma omp parallel for schedule(static) private(j)
+    for(i=1; i < csize - 1; i++) {
+      for(j=0; j < rsize; j++) {
+        const int interior = j > 0 && j < rsize - 1;
+        x[rb_idx(i, j)] = interior ? 0 : (double)(i*j);
+      }
+    }
     for(j=0; j < rsize; j++) {
-      x[idx(i, j)] = (double)(i*j);
-      y[idx(i, j)] = (double)(i*j);
+      x[rb_idx(0, j)] = 0;
+      x[rb_idx(csize - 1, j)] = (double)((csize - 1)*j);
+    }
+  } else if (mode == SOLVE) {
+    /* Grids of the storage type, which also initialises them */
+    ld = rsize;
+    x = malloc(rsize * csize * storages[storage].size);
+    y = malloc(rsize * csize * storages[storage].size);
+    storages[storage].init(x, y, rsize, csize);
+  } else if (mode == PADDED) {
+    ld = padded_size(rsize);
+    if (posix_memalign((void **)&x, 64, ld * csize * sizeof(*x)) ||
+        posix_memalign((void **)&y, 64, ld * csize * sizeof(*y))) {
+      printf("Unable to allocate grids\n");
+      exit(EXIT_FAILURE);
+    }
+  } else {
+    ld = rsize;
+    x = malloc(rsize * csize * sizeof(*x));
+    y = malloc(rsize * csize * sizeof(*y));
+    if (stencils[stencil].coefficients)
+      a = malloc(rsize * csize * sizeof(*a));
+  }
+  /* First touch: initialise the interior columns with the same
+   * partitioning as the sweeps, so each page is placed on the NUMA
+   * node of the thread that updates it. The r columns at either end
+   * are the fixed boundary. Coefficients vary between 1 and 2. */
+  if (mode != REDBLACK && mode != SOLVE) {
+#pragma omp parallel for schedule(static) private(j)
+    for(i=r; i < csize - r; i++) {
+      for(j=0; j < ld; j++) {
+        x[i*ld + j] = (double)(i*j);
+        y[i*ld + j] = (double)(i*j);
+        if (a)
+          a[i*ld + j] = 1 + 0.25*((i + 2*j) % 5);
+      }
+    }
+    for(i=0; i < r; i++) {
+      for(j=0; j < ld; j++) {
+        x[i*ld + j] = y[i*ld + j] = (double)(i*j);
+        x[(csize - 1 - i)*ld + j] = y[(csize - 1 - i)*ld + j] = (double)((csize - 1 - i)*j);
+        if (a) {
+          a[i*ld + j] = 1 + 0.25*((i + 2*j) % 5);
+          a[(csize - 1 - i)*ld + j] = 1 + 0.25*((csize - 1 - i + 2*j) % 5);
+        }
+      }
     }
-  }	  
+  }
+
 
+  if (mode == SOLVE) {
+    Snapshot *snap = snapshot_start(rsize * csize * storages[storage].size, &process_cpus);
+    size_t iterations;
+    double residual, error;
+    void *u;
+    runtime = storages[storage].solve(x, y, rsize, csize, tol, check_every, snap, &iterations, &residual, &u);
+    error = storages[storage].error(u, rsize, csize);
+    printf("SOLVE(%g, %zu, %s) size: (%zu, %zu) time: %lf iterations: %zu MLUP/s: %lf threads: %d MLUP/s/thread: %lf residual: %g error: %g\n",
+           tol, check_every, storages[storage].name, rsize, csize, runtime, iterations,
+           1e-6*iterations*(rsize-2)*(csize-2)/runtime, omp_get_max_threads(),
+           1e-6*iterations*(rsize-2)*(csize-2)/runtime/omp_get_max_threads(),
+           residual, error);
+    /* Time to solution is a single sample */
+    bench_stats(&runtime, 1, iterations, "s", &result);
+    snprintf(params, sizeof(params), "rows=%zu cols=%zu tol=%g check=%zu storage=%s",
+             rsize, csize, tol, check_every, storages[storage].name);
+    bench_report("fivepoint/SOLVE", params, &result, (double)(rsize-2)*(csize-2), "LUP");
+    if (snap) {
+      snapshot_finish(snap);
+      printf("snapshots: %zu every: %zu copy time: %lf wait time: %lf write time: %lf\n",
+             snap->count, snap->every, snap->copy_time, snap->wait_time, snap->write_time);
+      free(snap);
+    }
+  } else if (mode == REDBLACK) {
+    const size_t h = ld/2;
+    size_t iterations;
+    double residual, error = 0;
+    runtime = run_redblack_solve(x, rsize, csize, tol, omega, &iterations, &residual);
+    for (i = 1; i < csize - 1; i++)
+      for (j = 1; j < rsize - 1; j++)
+        error = fmax(error, fabs(x[rb_idx(i, j)] - (double)(i*j)));
+    printf("REDBLACK(%g, %g) size: (%zu, %zu) time: %lf iterations: %zu MLUP/s: %lf threads: %d MLUP/s/thread: %lf residual: %g error: %g\n",
+           tol, omega, rsize, csize, runtime, iterations,
+           1e-6*iterations*(rsize-2)*(csize-2)/runtime, omp_get_max_threads(),
+           1e-6*iterations*(rsize-2)*(csize-2)/runtime/omp_get_max_threads(),
+           residual, error);
+    bench_stats(&runtime, 1, iterations, "s", &result);
+    snprintf(params, sizeof(params), "rows=%zu cols=%zu tol=%g omega=%g", rsize, csize, tol, omega);
+    bench_report("fivepoint/REDBLACK", params, &result, (double)(rsize-2)*(csize-2), "LUP");
+  } else {
+    SweepArgs args = {mode, stencil, x, y, a, rsize, csize, ld, blocksize, depth};
+    const char *names[] = {"fivepoint/NORMAL", "fivepoint/TILED", "fivepoint/TEMPORAL", "fivepoint/PADDED"};
 
-  do {
+    bench_run(sweep_bench, &args, &result);
+    runtime = result.median*result.reps;
+
+    if (stencil)
+      printf("%s ", stencils[stencil].name);
     switch (mode) {
     case NORMAL:
-      runtime = run_jacobi_normal(x, y, rsize, csize, maxiter);
+      printf("NORMAL ");
       break;
     case TILED:
-      runtime = run_jacobi_tiled(x, y, rsize, csize, blocksize, maxiter);
+      printf("TILED(%zu) ", blocksize);
+      break;
+    case TEMPORAL:
+      printf("TEMPORAL(%zu, %zu) ", blocksize, depth);
+      break;
+    case PADDED:
+      printf("PADDED(%zu) ", ld);
+      break;
+    case SOLVE:
+    case REDBLACK:
       break;
     }
-    maxiter *= 2;
-  } while (runtime < 1.5);
-  maxiter /= 2;
-
-  switch (mode) {
-  case NORMAL:
-    printf("NORMAL ");
-    break;
-  case TILED:
-    printf("TILED(%zu) ", blocksize);
+    printf("size: (%zu, %zu) time: %lf iterations: %zu MLUP/s: %lf threads: %d MLUP/s/thread: %lf\n",
+           rsize, csize, runtime, result.reps, 1e-6*(rsize-2*r)*(csize-2*r)/result.median,
+           omp_get_max_threads(), 1e-6*(rsize-2*r)*(csize-2*r)/result.median/omp_get_max_threads());
+    snprintf(params, sizeof(params), "stencil=%s rows=%zu cols=%zu tile=%zu depth=%zu ld=%zu",
+             stencils[stencil].name, rsize, csize,
+             mode == TILED || mode == TEMPORAL ? blocksize : 0, mode == TEMPORAL ? depth : 0, ld);
+    bench_report(names[mode], params, &result, (double)(rsize-2*r)*(csize-2*r), "LUP");
   }
-  printf("size: (%zu, %zu) time: %lf iterations: %zu MLUP/s: %lf\n", rsize, csize,
-         runtime, maxiter, 1e-6*maxiter*(rsize-2)*(csize-2)/runtime);
   free(x);
   free(y);
+  free(a);
 
   LIKWID_MARKER_CLOSE;
   return 0;
@@ -0,0 +1,294 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <string.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_get_max_threads() 1
+#endif
+
+#ifdef LIKWID_PERFMON
+#include <likwid.h>
+#else
+#define LIKWID_MARKER_START(a) do { (void)a; } while (0)
+#define LIKWID_MARKER_STOP(a) do { (void)a; } while (0)
+#define LIKWID_MARKER_INIT do { } while (0)
+#define LIKWID_MARKER_THREADINIT do { } while (0)
+#define LIKWID_MARKER_CLOSE do { } while (0)
+#define LIKWID_MARKER_REGISTER(a) do { (void)a; } while (0)
+#endif  /* LIKWID_PERFMON */
+
+#include "../common/bench.h"
+#include "../common/affinity.h"
+
+/*
+ * The seven-point stencil on a 3D grid, the 3D counterpart of
+ * fivepoint.c. The grid is nz planes (the i index) of ny rows (j) of
+ * nx points (k), with k contiguous. As in fivepoint.c, the sweeps are
+ * parallelised over the outermost index with OpenMP, and the
+ * performance is reported in MLUP/s of interior points, so the two are
+ * directly comparable.
+ */
+
+typedef enum LoopMode {NORMAL, TILED} LoopMode;
+
+#define idx(i, j, k) (((i)*ny + (j))*nx + (k))
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* Cache to fit the planes of a tile in when no tile size is given, if
+ * sysconf doesn't know the L2 size */
+#define DEFAULT_CACHE_BYTES (256*1024)
+
+static double run_jacobi_normal(double * restrict x, double * restrict y, size_t nx, size_t ny, size_t nz, size_t maxiter)
+{
+  double start, end;
+
+  start = bench_timestamp();
+#pragma omp parallel
+  {
+    size_t i, j, k, iter = 0;
+    double *x_old, *x_new;
+
+    LIKWID_MARKER_START("UNTILED");
+    while (iter < maxiter) {
+      if (iter%2) {
+        x_old = x;
+        x_new = y;
+      } else {
+        x_old = y;
+        x_new = x;
+      }
+#pragma omp for schedule(static)
+      for (i = 1; i < nz - 1; i++) {
+        for (j = 1; j < ny - 1; j++) {
+          for (k = 1; k < nx - 1; k++) {
+            x_new[idx(i, j, k)] = (1.0/6)*((x_old[idx(i-1, j, k)] +
+                                            x_old[idx(i+1, j, k)] +
+                                            x_old[idx(i, j-1, k)] +
+                                            x_old[idx(i, j+1, k)] +
+                                            x_old[idx(i, j, k-1)] +
+                                            x_old[idx(i, j, k+1)] -
+                                            6*x_old[idx(i, j, k)]));
+          }
+        }
+      }
+      iter++;
+    }
+    LIKWID_MARKER_STOP("UNTILED");
+  }
+  end = bench_timestamp();
+
+  return end - start;
+}
+
+/*
+ * Tile the two inner dimensions into tx x ty blocks, and stream each
+ * block through all the planes. Updating plane i reads planes i-1, i,
+ * and i+1 of the block, so if three planes of the block stay in cache
+ * (the layer condition) each point of x_old comes from memory once per
+ * sweep rather than up to three times.
+ */
+static double run_jacobi_tiled(double * restrict x, double * restrict y, size_t nx, size_t ny, size_t nz,
+                               size_t tx, size_t ty, size_t maxiter)
+{
+  double start, end;
+
+  start = bench_timestamp();
+#pragma omp parallel
+  {
+    size_t i, j, k, jb, kb, iter = 0;
+    double *x_old, *x_new;
+
+    LIKWID_MARKER_START("TILED");
+    while (iter < maxiter) {
+      if (iter%2) {
+        x_old = x;
+        x_new = y;
+      } else {
+        x_old = y;
+        x_new = x;
+      }
+      for (jb = 1; jb < ny - 1; jb += ty) {
+        for (kb = 1; kb < nx - 1; kb += tx) {
+          /* Tiles only read x_old, so a thread can start on its planes
+           * of the next tile without waiting for the others. */
+#pragma omp for schedule(static) nowait
+          for (i = 1; i < nz - 1; i++) {
+            for (j = jb; j < MIN(jb + ty, ny - 1); j++) {
+              for (k = kb; k < MIN(kb + tx, nx - 1); k++) {
+                x_new[idx(i, j, k)] = (1.0/6)*((x_old[idx(i-1, j, k)] +
+                                                x_old[idx(i+1, j, k)] +
+                                                x_old[idx(i, j-1, k)] +
+                                                x_old[idx(i, j+1, k)] +
+                                                x_old[idx(i, j, k-1)] +
+                                                x_old[idx(i, j, k+1)] -
+                                                6*x_old[idx(i, j, k)]));
+              }
+            }
+          }
+        }
+      }
+#pragma omp barrier
+      iter++;
+    }
+    LIKWID_MARKER_STOP("TILED");
+  }
+  end = bench_timestamp();
+  return end - start;
+}
+
+/*
+ * Choose a tile so that three planes of it take at most half of a
+ * cache of the given size, leaving the other half for the planes of
+ * x_new and everything else. Keep whole rows (tx = nx - 2) if that
+ * leaves at least 8 rows per tile, so the inner loop stays long,
+ * otherwise use square-ish tiles, with tx a multiple of 8 doubles (a
+ * cache line).
+ */
+static void choose_tile(size_t nx, size_t ny, long cache, size_t *tx, size_t *ty)
+{
+  size_t points;
+
+  if (cache <= 0)
+    cache = DEFAULT_CACHE_BYTES;
+  points = (size_t)cache / 2 / (3*sizeof(double));
+  *tx = nx - 2;
+  if (points / *tx < 8) {
+    *tx = (size_t)sqrt((double)points) / 8 * 8;
+    if (*tx < 8)
+      *tx = 8;
+  }
+  *ty = points / *tx;
+  if (*ty < 1)
+    *ty = 1;
+  if (*tx > nx - 2)
+    *tx = nx - 2;
+  if (*ty > ny - 2)
+    *ty = ny - 2;
+}
+
+typedef struct SweepArgs {
+  LoopMode mode;
+  double *x, *y;
+  size_t nx, ny, nz, tx, ty;
+} SweepArgs;
+
+/* reps iterations of the NORMAL or TILED sweep */
+static double sweep_bench(void *ctx, size_t reps)
+{
+  SweepArgs *s = ctx;
+  switch (s->mode) {
+  case NORMAL:
+    return run_jacobi_normal(s->x, s->y, s->nx, s->ny, s->nz, reps);
+  case TILED:
+    return run_jacobi_tiled(s->x, s->y, s->nx, s->ny, s->nz, s->tx, s->ty, reps);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  size_t nx, ny, nz, tx = 0, ty = 0, i, j, k;
+  double *x = NULL, *y = NULL;
+  double runtime = 0;
+  SweepArgs args;
+  BenchResult result;
+  char params[128];
+
+  LoopMode mode;
+
+  if (argc != 5 && argc != 7) {
+    printf("Usage: %s <MODE> <nx> <ny> <nz> [<tile x> <tile y>]\n", argv[0]);
+    printf("  Where MODE is one of NORMAL or TILED\n");
+    printf("  x is the contiguous dimension, z the outermost\n");
+    printf("  If MODE is TILED, the tile size is chosen so that three\n");
+    printf("  planes of a tile fit in half the L2 cache unless given\n");
+    exit(EXIT_SUCCESS);
+  } else {
+    nx = atoi(argv[2]);
+    ny = atoi(argv[3]);
+    nz = atoi(argv[4]);
+    if (nx < 3 || ny < 3 || nz < 3) {
+      printf("Grid must be at least 3 points in each dimension\n");
+      exit(EXIT_SUCCESS);
+    }
+    if (!strcmp(argv[1], "TILED")) {
+      if (argc == 7) {
+        tx = atoi(argv[5]);
+        ty = atoi(argv[6]);
+        if (tx < 1 || ty < 1) {
+          printf("Tile sizes must be positive\n");
+          exit(EXIT_SUCCESS);
+        }
+      } else {
+        choose_tile(nx, ny, sysconf(_SC_LEVEL2_CACHE_SIZE), &tx, &ty);
+      }
+      mode = TILED;
+    } else if (!strcmp(argv[1], "NORMAL")) {
+      mode = NORMAL;
+    } else {
+      printf("Unknown loop mode '%s', expecting one of NORMAL or TILED\n", argv[1]);
+      exit(EXIT_SUCCESS);
+    }
+  }
+
+  LIKWID_MARKER_INIT;
+#pragma omp parallel
+  LIKWID_MARKER_THREADINIT;
+  LIKWID_MARKER_REGISTER("TILED");
+  LIKWID_MARKER_REGISTER("UNTILED");
+  pin_threads();
+  x = malloc(nx * ny * nz * sizeof(*x));
+  y = malloc(nx * ny * nz * sizeof(*y));
+  /* First touch with the same partitioning as the sweeps */
+#pragma omp parallel for schedule(static) private(j, k)
+  for(i=1; i < nz - 1; i++) {
+    for(j=0; j < ny; j++) {
+      for(k=0; k < nx; k++) {
+        x[idx(i, j, k)] = y[idx(i, j, k)] = (double)(i*j*k);
+      }
+    }
+  }
+  for(j=0; j < ny; j++) {
+    for(k=0; k < nx; k++) {
+      x[idx(0, j, k)] = y[idx(0, j, k)] = 0;
+      x[idx(nz - 1, j, k)] = y[idx(nz - 1, j, k)] = (double)((nz - 1)*j*k);
+    }
+  }
+
+  args.mode = mode;
+  args.x = x;
+  args.y = y;
+  args.nx = nx;
+  args.ny = ny;
+  args.nz = nz;
+  args.tx = tx;
+  args.ty = ty;
+  bench_run(sweep_bench, &args, &result);
+  runtime = result.median*result.reps;
+
+  switch (mode) {
+  case NORMAL:
+    printf("NORMAL ");
+    break;
+  case TILED:
+    printf("TILED(%zu, %zu) ", tx, ty);
+    break;
+  }
+  printf("size: (%zu, %zu, %zu) time: %lf iterations: %zu MLUP/s: %lf threads: %d MLUP/s/thread: %lf\n",
+         nx, ny, nz, runtime, result.reps, 1e-6*(nx-2)*(ny-2)*(nz-2)/result.median,
+         omp_get_max_threads(), 1e-6*(nx-2)*(ny-2)*(nz-2)/result.median/omp_get_max_threads());
+  snprintf(params, sizeof(params), "nx=%zu ny=%zu nz=%zu tx=%zu ty=%zu", nx, ny, nz, tx, ty);
+  bench_report(mode == TILED ? "sevenpoint/TILED" : "sevenpoint/NORMAL", params, &result,
+               (double)(nx-2)*(ny-2)*(nz-2), "LUP");
+  free(x);
+  free(y);
+
+  LIKWID_MARKER_CLOSE;
+  return 0;
+}
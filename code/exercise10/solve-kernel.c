@@ -0,0 +1,172 @@
+/*
+ * SOLVE for one storage type. fivepoint.c includes this file once per
+ * type, after defining
+ *
+ *   STORAGE       the type of the grids in memory
+ *   ACCUM         the type the update and the residual are computed in
+ *   SOLVE_FN(f)   the name of function f for this type
+ *
+ * The functions take the grids as void *, so that main can pick the
+ * type at run time from a table. To add a storage type, instantiate
+ * this file for it and add it to the table.
+ */
+
+/*
+ * Solve the Laplace equation to a tolerance with Jacobi iteration,
+ * x_new = x_old + 0.25*r, where r = x_old(i-1, j) + x_old(i+1, j) +
+ * x_old(i, j-1) + x_old(i, j+1) - 4 x_old(i, j) is the residual. That
+ * is the quantity the other modes compute, so the residual norm comes
+ * for free in the update sweep: every check_every iterations the sweep
+ * also accumulates |r|^2 (with an OpenMP reduction), instead of
+ * reading the grid again in a separate pass. We stop once
+ * |r| <= tol |r_0|, or once |r| has not gone below its smallest value
+ * so far for SOLVE_STALL iterations. In exact arithmetic it always
+ * goes down, so then we have hit the rounding error of the storage
+ * type.
+ *
+ * With snap, every snap->every iterations the new grid is copied to
+ * the snapshot buffer (in parallel) and handed to the writer.
+ *
+ * Sets *iterations to the number of sweeps, *residual to the last
+ * relative residual, and *result to the grid holding the solution.
+ * Returns the time to solution.
+ */
+static double SOLVE_FN(run_jacobi_solve)(void *xv, void *yv, size_t rsize, size_t csize, double tol, size_t check_every,
+                                         Snapshot *snap, size_t *iterations, double *residual, void **result)
+{
+  STORAGE * restrict x = xv;
+  STORAGE * restrict y = yv;
+  double start, end;
+  double rnorm2 = 0, r0norm2 = 0;
+  size_t niter = 0;
+
+  start = bench_timestamp();
+#pragma omp parallel
+  {
+    size_t i, j, iter = 0;
+    STORAGE *x_old, *x_new;
+    size_t best_iter = 0;
+    int converged = 0, stalled = 0;
+    double best_r2 = 0;
+
+    LIKWID_MARKER_START("SOLVE");
+    while (!converged && !stalled && iter < SOLVE_MAXITER) {
+      if (iter%2) {
+        x_old = x;
+        x_new = y;
+      } else {
+        x_old = y;
+        x_new = x;
+      }
+      if (iter % check_every == 0) {
+        double r2;
+#pragma omp single
+        rnorm2 = 0;
+#pragma omp for schedule(static) reduction(+:rnorm2)
+        for (i = 1; i < csize - 1; i++) {
+          ACCUM colnorm2 = 0;
+          /* Without this, the sum is a serial chain of adds, and the
+           * checking sweeps run at half speed */
+#pragma omp simd reduction(+:colnorm2)
+          for (j = 1; j < rsize - 1; j++) {
+            const ACCUM r = ((ACCUM)x_old[idx(i-1, j)] +
+                             (ACCUM)x_old[idx(i+1, j)] +
+                             (ACCUM)x_old[idx(i, j-1)] +
+                             (ACCUM)x_old[idx(i, j+1)] -
+                             4*(ACCUM)x_old[idx(i, j)]);
+            x_new[idx(i, j)] = (STORAGE)((ACCUM)x_old[idx(i, j)] + (ACCUM)0.25*r);
+            colnorm2 += r*r;
+          }
+          rnorm2 += colnorm2;
+        }
+        r2 = rnorm2;
+        if (iter == 0) {
+#pragma omp single
+          r0norm2 = r2;
+        }
+        /* Everyone has read rnorm2 before anyone resets it */
+#pragma omp barrier
+        converged = r2 <= tol*tol*r0norm2;
+        if (iter == 0 || r2 < best_r2) {
+          best_r2 = r2;
+          best_iter = iter;
+        }
+        stalled = iter - best_iter >= SOLVE_STALL;
+      } else {
+#pragma omp for schedule(static)
+        for (i = 1; i < csize - 1; i++) {
+          for (j = 1; j < rsize - 1; j++) {
+            x_new[idx(i, j)] = (STORAGE)((ACCUM)x_old[idx(i, j)] +
+                                         (ACCUM)0.25*((ACCUM)x_old[idx(i-1, j)] +
+                                                      (ACCUM)x_old[idx(i+1, j)] +
+                                                      (ACCUM)x_old[idx(i, j-1)] +
+                                                      (ACCUM)x_old[idx(i, j+1)] -
+                                                      4*(ACCUM)x_old[idx(i, j)]));
+          }
+        }
+      }
+      iter++;
+      if (snap && iter % snap->every == 0) {
+#pragma omp single
+        {
+          snapshot_wait(snap);
+          snap->copy_start = bench_timestamp();
+        }
+#pragma omp for schedule(static)
+        for (i = 0; i < csize; i++)
+          memcpy(&snap->buffer[i*rsize*sizeof(*x_new)], &x_new[i*rsize], rsize*sizeof(*x_new));
+#pragma omp single
+        {
+          snap->copy_time += bench_timestamp() - snap->copy_start;
+          snapshot_post(snap, iter);
+        }
+      }
+    }
+    LIKWID_MARKER_STOP("SOLVE");
+#pragma omp single
+    {
+      niter = iter;
+      *result = x_new;
+    }
+  }
+  end = bench_timestamp();
+  *iterations = niter;
+  *residual = r0norm2 > 0 ? sqrt(rnorm2 / r0norm2) : 0;
+  return end - start;
+}
+
+/*
+ * The initial grids for SOLVE: the boundary of x(i, j) = i*j, which
+ * is harmonic, so it is also the solution, and a zero interior. First
+ * touch with the same partitioning as the sweeps.
+ */
+static void SOLVE_FN(init)(void *xv, void *yv, size_t rsize, size_t csize)
+{
+  STORAGE *x = xv, *y = yv;
+  size_t i, j;
+
+#pragma omp parallel for schedule(static) private(j)
+  for (i = 1; i < csize - 1; i++) {
+    for (j = 0; j < rsize; j++) {
+      const int interior = j > 0 && j < rsize - 1;
+      x[idx(i, j)] = y[idx(i, j)] = interior ? 0 : (STORAGE)(i*j);
+    }
+  }
+  for (j = 0; j < rsize; j++) {
+    x[idx(0, j)] = y[idx(0, j)] = 0;
+    x[idx(csize - 1, j)] = y[idx(csize - 1, j)] = (STORAGE)((csize - 1)*j);
+  }
+}
+
+/* Largest error of the grid u against the solution i*j */
+static double SOLVE_FN(error)(const void *uv, size_t rsize, size_t csize)
+{
+  const STORAGE *u = uv;
+  double error = 0;
+  size_t i, j;
+
+  for (i = 1; i < csize - 1; i++)
+    for (j = 1; j < rsize - 1; j++)
+      error = fmax(error, fabs((double)u[idx(i, j)] - (double)(i*j)));
+  return error;
+}
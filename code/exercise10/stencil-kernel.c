@@ -0,0 +1,113 @@
+/*
+ * The NORMAL and TILED sweeps for one stencil. fivepoint.c includes
+ * this file once per stencil, after defining
+ *
+ *   STENCIL_FN(f)      the name of function f for this stencil
+ *   STENCIL_RADIUS     the largest offset in the stencil, which is also
+ *                      the width of the fixed boundary
+ *   STENCIL_POINTS(P)  P(di, dj, w) for each point of the stencil:
+ *                      x_new(i, j) is the sum of w*x_old(i+di, j+dj).
+ *                      The weights are constants, or, for a variable
+ *                      coefficient stencil, expressions in A(di, dj),
+ *                      the coefficient grid at (i+di, j+dj)
+ *
+ * The stencil expands to a single expression at compile time, so the
+ * update is fully unrolled with constant weights, and the loop over j
+ * vectorises. The sweeps skip the boundary, radius points wide.
+ *
+ * Both sweeps evaluate the same expression for every point, but the
+ * compiler may contract it into FMAs differently in the vector loop
+ * and its remainder, which fall on different j in the two sweeps. So
+ * with FMA contraction (gcc -march=native on an FMA capable CPU, say)
+ * TILED can differ from NORMAL in the last bits for stencils whose
+ * weights aren't powers of two. Compile with -ffp-contract=off to
+ * compare them bitwise.
+ */
+
+/* Update x_new(i, j) for j in [jlo, jhi) */
+static inline void STENCIL_FN(update)(const double * restrict x_old, double * restrict x_new,
+                                      const double * restrict a, size_t rsize, size_t i,
+                                      size_t jlo, size_t jhi)
+{
+  size_t j;
+
+  (void)a;
+#define A(di, dj) a[idx(i + (di), j + (dj))]
+#define P(di, dj, w) + (w)*x_old[idx(i + (di), j + (dj))]
+#pragma omp simd
+  for (j = jlo; j < jhi; j++) {
+    /* -0.0 + y is y for every y, so this add is folded away */
+    x_new[idx(i, j)] = -0.0 STENCIL_POINTS(P);
+  }
+#undef P
+#undef A
+}
+
+static double STENCIL_FN(normal)(double * restrict x, double * restrict y, const double * restrict a,
+                                 size_t rsize, size_t csize, size_t maxiter)
+{
+  const size_t r = STENCIL_RADIUS;
+  double start, end;
+
+  start = bench_timestamp();
+#pragma omp parallel
+  {
+    size_t i, iter = 0;
+    double *x_old, *x_new;
+
+    LIKWID_MARKER_START("UNTILED");
+    while (iter < maxiter) {
+      if (iter%2) {
+        x_old = x;
+        x_new = y;
+      } else {
+        x_old = y;
+        x_new = x;
+      }
+#pragma omp for schedule(static)
+      for (i = r; i < csize - r; i++)
+        STENCIL_FN(update)(x_old, x_new, a, rsize, i, r, rsize - r);
+      iter++;
+    }
+    LIKWID_MARKER_STOP("UNTILED");
+  }
+  end = bench_timestamp();
+  return end - start;
+}
+
+static double STENCIL_FN(tiled)(double * restrict x, double * restrict y, const double * restrict a,
+                                size_t rsize, size_t csize, size_t blocksize, size_t maxiter)
+{
+  const size_t r = STENCIL_RADIUS;
+  double start, end;
+
+  start = bench_timestamp();
+#pragma omp parallel
+  {
+    size_t i, jb, iter = 0;
+    double *x_old, *x_new;
+
+    LIKWID_MARKER_START("TILED");
+    while (iter < maxiter) {
+      if (iter%2) {
+        x_old = x;
+        x_new = y;
+      } else {
+        x_old = y;
+        x_new = x;
+      }
+      for (jb = r; jb < rsize - r; jb += blocksize) {
+        /* Tiles only read x_old, so a thread can start on its columns
+         * of the next tile without waiting for the others. */
+#pragma omp for schedule(static) nowait
+        for (i = r; i < csize - r; i++)
+          STENCIL_FN(update)(x_old, x_new, a, rsize, i, jb, MIN(jb + blocksize, rsize - r));
+      }
+#pragma omp barrier
+      iter++;
+    }
+    LIKWID_MARKER_STOP("TILED");
+  }
+  end = bench_timestamp();
+  return end - start;
+}
@@ -5,6 +5,10 @@ from matplotlib import pyplot
 
 parser = argparse.ArgumentParser()
 parser.add_argument("output", type=str)
+parser.add_argument("--peak", type=str, default=None,
+                    help="Measured peak, output of code/exercise05/throughput peak")
+parser.add_argument("--peak-isa", type=str, default="AVX",
+                    help="Column of the peak file to use")
 
 args, _ = parser.parse_known_args()
 
@@ -13,6 +17,8 @@ MARKERSIZE = 12
 
 STREAM_TRIAD = 12  # GB/s
 PEAK_FLOPS = 46.4  # GFLOP/s
+if args.peak is not None:
+    PEAK_FLOPS = numpy.nanmax(numpy.genfromtxt(args.peak, names=True)[args.peak_isa])
 
 
 fig = pyplot.figure(figsize=(9, 5), frameon=False)
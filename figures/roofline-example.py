@@ -5,6 +5,10 @@ from matplotlib import pyplot
 
 parser = argparse.ArgumentParser()
 parser.add_argument("output", type=str)
+parser.add_argument("--peak", type=str, default=None,
+                    help="Measured peak, output of code/exercise05/throughput peak")
+parser.add_argument("--peak-isa", type=str, default="AVX",
+                    help="Column of the peak file to use")
 
 args, _ = parser.parse_known_args()
 
@@ -14,6 +18,8 @@ MARKERSIZE = 12
 # PEAK_BW = 119.4 * (num_processes // 24)      # GB/s
 STREAM_TRIAD = 11.6  # GB/s
 PEAK_FLOPS = 46.4  # GFLOP/s
+if args.peak is not None:
+    PEAK_FLOPS = numpy.nanmax(numpy.genfromtxt(args.peak, names=True)[args.peak_isa])
 
 
 fig = pyplot.figure(figsize=(9, 5), frameon=False)
@@ -5,6 +5,12 @@ from matplotlib import pyplot
 
 parser = argparse.ArgumentParser()
 parser.add_argument("output", type=str)
+parser.add_argument("--data", type=str, default=None,
+                    help="Measured throughput, output of code/exercise05/throughput reduction")
+parser.add_argument("--peak", type=str, default=None,
+                    help="Measured peak, output of code/exercise05/throughput peak")
+parser.add_argument("--isa", type=str, default="AVX",
+                    help="SIMD column of the data files to plot (FMA128, AVX, AVX512)")
 
 args, _ = parser.parse_known_args()
 
@@ -55,10 +61,20 @@ scalar = numpy.asarray([
     [64e6, 2449.17],
     [128e6, 2445.51]])
 
+if args.data is not None:
+    data = numpy.genfromtxt(args.data, names=True)
+    simd = numpy.stack([data["BYTES"], data[args.isa]], axis=1)
+    scalar = numpy.stack([data["BYTES"], data["SCALAR"]], axis=1)
+if args.peak is not None:
+    # A sum is one add per element: assume adds issue at the same rate
+    # as FMAs (two flops), which holds from Skylake on.
+    peak = numpy.genfromtxt(args.peak, names=True)
+    SIMD_PEAK = numpy.nanmax(peak[args.isa]) * 1e3 / 2
+    SCALAR_PEAK = numpy.nanmax(peak["SCALAR"]) * 1e3 / 2
 
 fig, axes = pyplot.subplots(1)
 
-axes.plot(simd[:, 0], simd[:, 1], "o-", label="SIMD (AVX)")
+axes.plot(simd[:, 0], simd[:, 1], "o-", label="SIMD (%s)" % args.isa)
 axes.plot(scalar[:, 0], scalar[:, 1], "v-", label="Scalar")
 
 axes.axhline(SIMD_PEAK, color="r", linestyle="--", label="SIMD Peak")